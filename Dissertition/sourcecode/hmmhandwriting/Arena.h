@@ -0,0 +1,201 @@
+#ifndef __Arena__
+#define __Arena__
+
+#include <iostream>
+#include <new>
+#include <stdlib.h>
+#include <vector>
+
+#ifdef _MSC_VER
+#define RH_THREAD_LOCAL __declspec(thread)
+#else
+#define RH_THREAD_LOCAL __thread
+#endif
+
+//c++11, and cl from VS2015 on, run the destructors of thread_local objects when a thread exits
+#if __cplusplus>=201103L || (defined(_MSC_VER) && _MSC_VER>=1900)
+#define RH_THREAD_EXIT
+#endif
+
+using namespace std;
+
+namespace redhat{
+	/* Scratch memory for the decoders. Buffers are handed out by bumping a pointer and given
+	 * back all at once with release(), so the trellis can be sized from the actual number of
+	 * states and observations without using the stack. When a decode needed more than one
+	 * block, the blocks are merged into one on the next release(0), after which decodes of
+	 * that size or smaller make no allocations at all.
+	 */
+	/* One T for each thread that asks for it, made on first use. Where RH_THREAD_EXIT is defined
+	 * it is deleted when its thread exits. Elsewhere the compiler only keeps a plain pointer per
+	 * thread, and one T stays behind for every thread that ever used it, until release() is
+	 * called from that thread or the process ends; with a pool of worker threads that is one T
+	 * per worker. release() must not be called while a reference from get() is still in use.
+	 */
+	template<class T>
+	class ThreadLocal{
+		public:
+			static T &get();
+			static void release();
+		private:
+#ifdef RH_THREAD_EXIT
+			struct Owner{
+				T *object;
+				Owner(): object(NULL){}
+				~Owner(){ delete object; }
+			};
+#endif
+			static T *&slot();
+	};
+
+	template<class T>
+	T &ThreadLocal<T>::get(){
+		T *&object = ThreadLocal<T>::slot();
+		if(object==NULL){
+			object = new T();
+		}
+		return *object;
+	}
+
+	template<class T>
+	void ThreadLocal<T>::release(){
+		T *&object = ThreadLocal<T>::slot();
+		delete object;
+		object = NULL;
+	}
+
+	template<class T>
+	T *&ThreadLocal<T>::slot(){
+#ifdef RH_THREAD_EXIT
+		static thread_local Owner owner;
+		return owner.object;
+#else
+		//a plain pointer, since older compilers only allow thread-local storage for simple types
+		static RH_THREAD_LOCAL T *object = NULL;
+		return object;
+#endif
+	}
+
+	class Arena{
+		public:
+			Arena();
+			~Arena();
+			template<class T> T *allocate(int count);
+			size_t mark();//position to release() back to
+			void release(size_t position);
+			size_t capacity();
+
+			static Arena &local();//one arena per thread
+			static void releaseLocal();//free the calling thread's arena, local() makes a new one
+		private:
+			static const size_t ALIGNMENT = 64;
+			static const size_t MINIMUM_BLOCK = 64*1024;
+
+			vector<char *> blocks;
+			vector<size_t> sizes;
+			int currentBlock;
+			size_t used;//bytes used in the current block
+			size_t before;//bytes in the blocks before the current one
+
+			char *allocateBytes(size_t bytes);
+			char *newBlock(size_t bytes);
+
+			Arena(const Arena &);
+			Arena &operator=(const Arena &);
+	};
+
+	Arena::Arena(){
+		currentBlock=0;
+		used=0;
+		before=0;
+	}
+
+	Arena::~Arena(){
+		for(int i=0; i<blocks.size(); i++){
+			free(blocks[i]);
+		}
+	}
+
+	template<class T>
+	T *Arena::allocate(int count){
+		return (T *)Arena::allocateBytes(count*sizeof(T));
+	}
+
+	char *Arena::newBlock(size_t bytes){
+		char *block = (char *)malloc(bytes+ALIGNMENT);
+		if(block==NULL){
+			throw bad_alloc();
+		}
+		return block;
+	}
+
+	char *Arena::allocateBytes(size_t bytes){
+		//even an empty buffer gets its own line, so a decoder can still write its first cell
+		if(bytes==0) bytes = 1;
+		bytes = ((bytes+ALIGNMENT-1)/ALIGNMENT)*ALIGNMENT;
+		//move on to the next block that has room, adding one if none has
+		while(currentBlock<blocks.size() && used+bytes>sizes[currentBlock]){
+			before += sizes[currentBlock];
+			currentBlock++;
+			used = 0;
+		}
+		if(currentBlock==blocks.size()){
+			size_t size = MINIMUM_BLOCK;
+			if(blocks.size()>0 && 2*sizes.back()>size) size = 2*sizes.back();
+			if(bytes>size) size = bytes;
+			blocks.push_back(Arena::newBlock(size));
+			sizes.push_back(size);
+		}
+		//malloc only promises 16 bytes, so line each block up on ALIGNMENT
+		char *start = blocks[currentBlock];
+		start += (ALIGNMENT-((size_t)start)%ALIGNMENT)%ALIGNMENT;
+		char *memory = start+used;
+		used += bytes;
+		return memory;
+	}
+
+	size_t Arena::mark(){
+		return before+used;
+	}
+
+	void Arena::release(size_t position){
+		if(position==0 && blocks.size()>1){
+			//merge the blocks so the next decode of this size fits into one
+			size_t total = 0;
+			for(int i=0; i<blocks.size(); i++){
+				total += sizes[i];
+				free(blocks[i]);
+			}
+			blocks.clear();
+			sizes.clear();
+			blocks.push_back(Arena::newBlock(total));
+			sizes.push_back(total);
+		}
+		currentBlock=0;
+		before=0;
+		used=position;
+		while(currentBlock<blocks.size() && used>sizes[currentBlock]){
+			used -= sizes[currentBlock];
+			before += sizes[currentBlock];
+			currentBlock++;
+		}
+	}
+
+	size_t Arena::capacity(){
+		size_t total = 0;
+		for(int i=0; i<sizes.size(); i++){
+			total += sizes[i];
+		}
+		return total;
+	}
+
+	Arena &Arena::local(){
+		return ThreadLocal<Arena>::get();
+	}
+
+	void Arena::releaseLocal(){
+		ThreadLocal<Arena>::release();
+	}
+}
+
+#endif //__Arena__
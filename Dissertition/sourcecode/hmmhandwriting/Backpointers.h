@@ -0,0 +1,143 @@
+#ifndef __Backpointers__
+#define __Backpointers__
+
+#include <iostream>
+#include <string.h>
+#include "Arena.h"
+
+namespace rh = redhat;
+using namespace std;
+
+namespace redhat{
+	/* The previous state of every node of the trellis, packed into a bit array.
+	 * In a left-to-right model a node can only come from the first state or from a state at most
+	 * jumpWidth states back, so only the jump d = j-path is kept, with four more codes for the other
+	 * values a node can hold: 0 for a longer jump from the first state, stateNum-1 for a node that
+	 * was never reached, -1 for the nodes a start of stroke rules out and -2 for the ones an end of
+	 * stroke rules out. The first state's row reaches every state of the trained models, and this
+	 * way it doesn't count: with their jumps of 3 that is 3 bits a node, whatever the model's size.
+	 * Models that can go back to an earlier state keep path+2 instead, which still fits in a few bits.
+	 */
+	class Backpointers{
+		public:
+			int bits;//bits per node
+
+			Backpointers();
+			void reset(rh::Arena &arena, int stateNum, int columns, int jumpWidth, bool leftToRight);
+			void clear();//ready to be filled again
+			void setColumn(int i, const int *path);//pack the previous states of column i
+			int get(int i, int j);//the previous state of state j in column i
+			size_t bytes();
+		private:
+			unsigned int *words;
+			int stateNum;
+			int columns;
+			int jumpWidth;
+			bool relative;
+			unsigned int mask;
+
+			unsigned int encode(int j, int path);
+			int decode(int j, unsigned int code);
+	};
+
+	Backpointers::Backpointers(){
+		bits=0;
+		words=NULL;
+		stateNum=0;
+		columns=0;
+		jumpWidth=0;
+		relative=true;
+		mask=0;
+	}
+
+	void Backpointers::reset(rh::Arena &arena, int stateNum, int columns, int jumpWidth, bool leftToRight){
+		this->stateNum = stateNum;
+		this->columns = columns;
+		this->jumpWidth = jumpWidth;
+		relative = leftToRight;
+		//relative: 0..jumpWidth, then from the first state, never reached, -1 and -2. absolute: -2..stateNum-1
+		int codes = relative ? jumpWidth+5 : stateNum+2;
+		bits = 1;
+		while((1<<bits)<codes){
+			bits++;
+		}
+		mask = (1u<<bits)-1;
+		//one spare word so a code at the very end can be read as a pair of words
+		words = arena.allocate<unsigned int>(Backpointers::bytes()/sizeof(unsigned int));
+		Backpointers::clear();
+	}
+
+	void Backpointers::clear(){
+		memset(words, 0, Backpointers::bytes());
+	}
+
+	unsigned int Backpointers::encode(int j, int path){
+		if(!relative){
+			return path+2;
+		}
+		if(path>=0 && path<=j && j-path<=jumpWidth){
+			return j-path;
+		}
+		if(path==0){
+			return jumpWidth+1;
+		}
+		if(path==-1){
+			return jumpWidth+3;
+		}
+		if(path==-2){
+			return jumpWidth+4;
+		}
+		return jumpWidth+2;//stateNum-1, a node that was never reached
+	}
+
+	int Backpointers::decode(int j, unsigned int code){
+		if(!relative){
+			return (int)code-2;
+		}
+		int offset = code;
+		if(offset<=jumpWidth){
+			return j-offset;
+		}
+		if(offset==jumpWidth+1){
+			return 0;
+		}
+		if(offset==jumpWidth+3){
+			return -1;
+		}
+		if(offset==jumpWidth+4){
+			return -2;
+		}
+		return stateNum-1;
+	}
+
+	void Backpointers::setColumn(int i, const int *path){
+		size_t position = (size_t)i*stateNum*bits;
+		for(int j=0; j<stateNum; j++){
+			unsigned int code = Backpointers::encode(j, path[j]);
+			size_t word = position/32;
+			int shift = position%32;
+			words[word] |= code<<shift;
+			if(shift+bits>32){
+				words[word+1] |= code>>(32-shift);
+			}
+			position += bits;
+		}
+	}
+
+	int Backpointers::get(int i, int j){
+		size_t position = ((size_t)i*stateNum+j)*bits;
+		size_t word = position/32;
+		int shift = position%32;
+		unsigned int code = words[word]>>shift;
+		if(shift+bits>32){
+			code |= words[word+1]<<(32-shift);
+		}
+		return Backpointers::decode(j, code&mask);
+	}
+
+	size_t Backpointers::bytes(){
+		return (((size_t)stateNum*columns*bits+31)/32+1)*sizeof(unsigned int);
+	}
+}
+
+#endif //__Backpointers__
@@ -0,0 +1,279 @@
+#ifndef __BatchViterbi__
+#define __BatchViterbi__
+
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include "Constants.h"
+#include "Model.h"
+#include "Arena.h"
+#include "ViterbiKernel.h"
+#include "ParallelViterbi.h"
+#include "StrokeViterbi.h"
+#include "ViterbiResult.h"
+#include "Viterbi.h"
+
+namespace rh = redhat;
+using namespace std;
+
+namespace redhat{
+	/* Full decoding of many observations against the same model, as optimise does with all the
+	 * samples of a character. Viterbi::decode goes across the states of one observation, which
+	 * for the stroke shapes is only a handful of terms a state. Here LANES observations go through
+	 * the trellis side by side instead, one to a lane: the scores are kept as
+	 * column[state*LANES+lane], so every term of the recursion is one vector add and compare for
+	 * all the lanes, with the transition the same in every lane and the distribution looked up
+	 * for each lane's own symbol.
+	 *  - the observations are sorted by length and taken LANES at a time, so the lanes of a batch
+	 *    run out at about the same column; a lane that has run out, or was never filled, is still
+	 *    worked out but nothing of it is kept,
+	 *  - a lane on a stroke marker is worked out again on its own with Viterbi::calculateColumn,
+	 *  - the previous states of all the lanes are kept together and every lane is backtracked
+	 *    like in Viterbi::decode.
+	 * The terms of a state are the transitions into it that are not LOGZERO, tried nearest first
+	 * with the same comparison as ViterbiKernel and StrokeKernel, so the paths and probabilities
+	 * are the same as those of Viterbi::decode. Models that can go back to an earlier state, and
+	 * machines without AVX2, are decoded one observation at a time. With RH_PARALLEL=on an
+	 * observation long enough to be cut into chunks for several threads goes to ParallelViterbi
+	 * on its own, and its path may then differ from that of Viterbi::decode on a rounding tie.
+	 */
+	class BatchViterbi{
+		public:
+			static void decode(const rh::Model &model, const vector< vector<int> > &observations, vector<rh::ViterbiResult> &results);
+
+			static const int LANES = 8;
+		private:
+			static void decodeBatch(const rh::Model &model, const vector< vector<int> > &observations, const int *samples, vector<rh::ViterbiResult> &results, rh::Arena &arena);
+#ifdef RH_X86
+			static void avx512Column(const double *previous, const int *sourceStart, const int *sourceState, const double *sourceTran, int stateNum, const double *distribution, double *next, int *path);
+			static void avx2Column(const double *previous, const int *sourceStart, const int *sourceState, const double *sourceTran, int stateNum, const double *distribution, double *next, int *path);
+#endif
+			static void column(const double *previous, const int *sourceStart, const int *sourceState, const double *sourceTran, int stateNum, const double *distribution, double *next, int *path);
+			static bool useLanes();
+	};
+
+	void BatchViterbi::decode(const rh::Model &model, const vector< vector<int> > &observations, vector<rh::ViterbiResult> &results){
+		results.resize(observations.size());
+		if(!model.leftToRight||!BatchViterbi::useLanes()){
+			rh::DecoderWorkspace &workspace = rh::DecoderWorkspace::local();
+			for(int s=0; s<observations.size(); s++){
+				if(observations[s].size()==0 || model.stateNum==0){//as the lanes leave them
+					results[s].probability = rh::LOGZERO;
+					results[s].path.clear();
+					continue;
+				}
+				if(rh::ParallelViterbi::use() && rh::ParallelViterbi::chunks(observations[s].size())>1){
+					results[s].probability = rh::ParallelViterbi::decode(model, observations[s], workspace);
+				}else{
+					results[s].probability = rh::Viterbi::decode(model, observations[s], workspace);
+				}
+				results[s].path = workspace.path;
+			}
+			return;
+		}
+
+		//sort by length, longest first, so the lanes of a batch are about as long as each other
+		vector< pair<int, int> > order;
+		for(int s=0; s<observations.size(); s++){
+			results[s].probability = rh::LOGZERO;
+			results[s].path.clear();
+			if(observations[s].size()>0 && model.stateNum>0 && rh::ParallelViterbi::use() && rh::ParallelViterbi::chunks(observations[s].size())>1){
+				rh::DecoderWorkspace &workspace = rh::DecoderWorkspace::local();
+				results[s].probability = rh::ParallelViterbi::decode(model, observations[s], workspace);
+				results[s].path = workspace.path;
+			}else if(observations[s].size()>0 && model.stateNum>0){
+				order.push_back(make_pair(-(int)observations[s].size(), s));
+			}
+		}
+		sort(order.begin(), order.end());
+
+		rh::Arena &arena = rh::Arena::local();
+		int samples[LANES];
+		for(int first=0; first<order.size(); first+=LANES){
+			for(int l=0; l<LANES; l++){
+				samples[l] = first+l<order.size() ? order[first+l].second : -1;
+			}
+			BatchViterbi::decodeBatch(model, observations, samples, results, arena);
+		}
+	}
+
+	void BatchViterbi::decodeBatch(const rh::Model &model, const vector< vector<int> > &observations, const int *samples, vector<rh::ViterbiResult> &results, rh::Arena &arena){
+		int tranColumn = model.stateNum;
+		size_t arenaMark = arena.mark();
+
+		//the transitions into every state that are not LOGZERO, nearest first
+		int *sourceStart = arena.allocate<int>(tranColumn+1);
+		int sources = 0;
+		for(int j=0; j<tranColumn; j++){
+			for(int k=j; k>=0; k--){
+				if(model.transition(k, j)!=rh::LOGZERO) sources++;
+			}
+		}
+		int *sourceState = arena.allocate<int>(sources);
+		double *sourceTran = arena.allocate<double>(sources);
+		sources = 0;
+		for(int j=0; j<tranColumn; j++){
+			sourceStart[j] = sources;
+			for(int k=j; k>=0; k--){
+				if(model.transition(k, j)!=rh::LOGZERO){
+					sourceState[sources] = k;
+					sourceTran[sources] = model.transition(k, j);
+					sources++;
+				}
+			}
+		}
+		sourceStart[tranColumn] = sources;
+
+		int matrixColumn = 0;//the longest lane
+		int length[LANES];
+		for(int l=0; l<LANES; l++){
+			length[l] = samples[l]<0 ? 0 : observations[samples[l]].size();
+			matrixColumn = max(matrixColumn, length[l]);
+		}
+		double *previous = arena.allocate<double>(tranColumn*LANES);
+		double *next = arena.allocate<double>(tranColumn*LANES);
+		double *distribution = arena.allocate<double>(tranColumn*LANES);
+		//the previous states of every node, trellisPath[(i*tranColumn+j)*LANES+lane]. Unpacked, so the
+		//vector column can store them straight away; training samples are short.
+		int *trellisPath = arena.allocate<int>(matrixColumn*tranColumn*LANES);
+		double *lanePrevious = arena.allocate<double>(tranColumn);//one lane on its own, for the stroke markers
+		double *laneNext = arena.allocate<double>(tranColumn);
+		int *lanePath = arena.allocate<int>(tranColumn);
+		int currentStrokeNum[LANES];
+		for(int l=0; l<LANES; l++){
+			currentStrokeNum[l] = 1;
+		}
+		rh::ColumnKernel kernel = rh::ViterbiKernel::kernel();
+		rh::StrokeColumn strokeKernel = rh::StrokeViterbi::kernel(model);
+
+		for(int j=0; j<tranColumn; j++){
+			for(int l=0; l<LANES; l++){
+				previous[j*LANES+l] = j==0 && length[l]>0 ? model.emission(observations[samples[l]][0])[0] : rh::LOGZERO;
+			}
+		}
+		for(int l=0; l<LANES; l++){
+			if(length[l]==1){
+				results[samples[l]].probability = previous[(tranColumn-1)*LANES+l];
+			}
+		}
+
+		for(int i=1; i<matrixColumn; i++){
+			int symbol[LANES];
+			const double *laneDis[LANES];//the distribution of each lane's symbol, a row of every state
+			for(int l=0; l<LANES; l++){
+				symbol[l] = i<length[l] ? observations[samples[l]][i] : 0;
+				laneDis[l] = model.emission(symbol[l]);
+			}
+			for(int j=0; j<tranColumn; j++){
+				for(int l=0; l<LANES; l++){
+					distribution[j*LANES+l] = laneDis[l][j];
+				}
+			}
+			int *path = trellisPath+i*tranColumn*LANES;
+			BatchViterbi::column(previous, sourceStart, sourceState, sourceTran, tranColumn, distribution, next, path);
+			for(int l=0; l<LANES; l++){
+				if(i<length[l] && (symbol[l]>15||symbol[l]<0)){
+					for(int j=0; j<tranColumn; j++){
+						lanePrevious[j] = previous[j*LANES+l];
+					}
+					rh::Viterbi::calculateColumn(model, symbol[l], currentStrokeNum[l], lanePrevious, laneNext, lanePath, kernel, strokeKernel);
+					for(int j=0; j<tranColumn; j++){
+						next[j*LANES+l] = laneNext[j];
+						path[j*LANES+l] = lanePath[j];
+					}
+				}
+			}
+			std::swap(previous, next);
+			for(int l=0; l<LANES; l++){
+				if(i==length[l]-1){
+					results[samples[l]].probability = previous[(tranColumn-1)*LANES+l];
+				}
+			}
+		}
+
+		//backtracking as in Viterbi::decode
+		for(int l=0; l<LANES; l++){
+			if(length[l]==0){
+				continue;
+			}
+			int lastPath = length[l]>1 ? trellisPath[((length[l]-1)*tranColumn+tranColumn-1)*LANES+l] : 0;
+			int currentPath = tranColumn-1;
+			if(lastPath<0||(length[l]==1&&tranColumn>1)){
+				currentPath = -1;
+			}
+			vector<int> &mostPossiblePath = results[samples[l]].path;
+			mostPossiblePath.resize(length[l]>1 ? length[l] : 2);
+			mostPossiblePath[mostPossiblePath.size()-1] = currentPath;
+			mostPossiblePath[mostPossiblePath.size()-2] = lastPath;
+			int previousPath = lastPath;
+			for(int i=length[l]-2; i>0; i--){
+				if(previousPath>=0){
+					previousPath = trellisPath[(i*tranColumn+previousPath)*LANES+l];
+				}
+				mostPossiblePath[i-1] = previousPath;
+			}
+		}
+
+		arena.release(arenaMark);
+	}
+
+#ifdef RH_X86
+	RH_TARGET("avx512f")
+	void BatchViterbi::avx512Column(const double *previous, const int *sourceStart, const int *sourceState, const double *sourceTran, int stateNum, const double *distribution, double *next, int *path){
+		const __m512d logZero = _mm512_set1_pd(LOGZERO);
+		const __m512d lastState = _mm512_set1_pd(stateNum-1);
+		for(int j=0; j<stateNum; j++){
+			__m512d best = logZero;
+			__m512d bestPath = _mm512_set1_pd(j);
+			for(int s=sourceStart[j]; s<sourceStart[j+1]; s++){
+				__m512d temp = _mm512_add_pd(_mm512_loadu_pd(previous+sourceState[s]*LANES), _mm512_set1_pd(sourceTran[s]));
+				__mmask8 better = _mm512_cmp_pd_mask(temp, best, _CMP_GT_OQ);
+				best = _mm512_mask_blend_pd(better, best, temp);
+				bestPath = _mm512_mask_blend_pd(better, bestPath, _mm512_set1_pd(sourceState[s]));
+			}
+			_mm512_storeu_pd(next+j*LANES, _mm512_add_pd(best, _mm512_loadu_pd(distribution+j*LANES)));
+			bestPath = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(best, logZero, _CMP_EQ_OQ), bestPath, lastState);
+			_mm256_storeu_si256((__m256i *)(path+j*LANES), _mm512_cvtpd_epi32(bestPath));
+		}
+	}
+
+	RH_TARGET("avx2")
+	void BatchViterbi::avx2Column(const double *previous, const int *sourceStart, const int *sourceState, const double *sourceTran, int stateNum, const double *distribution, double *next, int *path){
+		const __m256d logZero = _mm256_set1_pd(LOGZERO);
+		const __m256d lastState = _mm256_set1_pd(stateNum-1);
+		for(int j=0; j<stateNum; j++){
+			for(int half=0; half<LANES; half+=4){
+				__m256d best = logZero;
+				__m256d bestPath = _mm256_set1_pd(j);
+				for(int s=sourceStart[j]; s<sourceStart[j+1]; s++){
+					__m256d temp = _mm256_add_pd(_mm256_loadu_pd(previous+sourceState[s]*LANES+half), _mm256_set1_pd(sourceTran[s]));
+					__m256d better = _mm256_cmp_pd(temp, best, _CMP_GT_OQ);
+					best = _mm256_blendv_pd(best, temp, better);
+					bestPath = _mm256_blendv_pd(bestPath, _mm256_set1_pd(sourceState[s]), better);
+				}
+				_mm256_storeu_pd(next+j*LANES+half, _mm256_add_pd(best, _mm256_loadu_pd(distribution+j*LANES+half)));
+				bestPath = _mm256_blendv_pd(bestPath, lastState, _mm256_cmp_pd(best, logZero, _CMP_EQ_OQ));
+				_mm_storeu_si128((__m128i *)(path+j*LANES+half), _mm256_cvtpd_epi32(bestPath));
+			}
+		}
+	}
+#endif
+
+	//one column of every lane: the first term of a state starts at LOGZERO with the state itself, like ViterbiKernel
+	void BatchViterbi::column(const double *previous, const int *sourceStart, const int *sourceState, const double *sourceTran, int stateNum, const double *distribution, double *next, int *path){
+#ifdef RH_X86
+		if(ViterbiKernel::hasAvx512()){
+			BatchViterbi::avx512Column(previous, sourceStart, sourceState, sourceTran, stateNum, distribution, next, path);
+		}else{
+			BatchViterbi::avx2Column(previous, sourceStart, sourceState, sourceTran, stateNum, distribution, next, path);
+		}
+#endif
+	}
+
+	//one lane at a time in plain code is slower than Viterbi::decode, which goes across the states
+	bool BatchViterbi::useLanes(){
+		return ViterbiKernel::hasAvx2();
+	}
+}
+
+#endif //__BatchViterbi__
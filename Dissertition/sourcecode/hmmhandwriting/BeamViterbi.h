@@ -0,0 +1,210 @@
+#ifndef __BeamViterbi__
+#define __BeamViterbi__
+
+#include <iostream>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "Arena.h"
+#include "Constants.h"
+#include "Model.h"
+#include "Viterbi.h"
+
+namespace rh = redhat;
+using namespace std;
+
+namespace redhat{
+	/* The beam of BeamViterbi and what it saved. width is how far below the best score of its
+	 * column a node may be and still be kept, in nats, 0 for no beam inside the trellis. The
+	 * counters add up over every decode the beam is given to, for one request of recognise.
+	 */
+	class Beam{
+		public:
+			double width;
+			int decodes;//decodes started
+			long cells;//nodes worked out
+			long skipped;//nodes left out, outside the active states or after the decode was given up
+			int givenUp;//decodes stopped because they couldn't beat the threshold any more
+
+			Beam(double width);
+
+			static double setting();//RH_BEAM in nats, picked once, -1 when it isn't set
+		private:
+			static double chooseSetting();
+			static const double chosenSetting;//set before main, decoder threads only read it
+	};
+
+	/* Score-only Viterbi that stops early. Every log-probability is at most 0, so the best score
+	 * of a column never goes up from one column to the next, and once it is no better than
+	 * threshold the final score can't be either: the decode is given up and gives LOGZERO. With
+	 * threshold the score of the K-th best model so far, a model that is given up wouldn't have
+	 * made the K best, ties included, since an equal score added later ranks after it; so that much
+	 * is exact. A beam width above 0 also drops the nodes of a column more than width below its
+	 * best, which can lose the best path and is not exact.
+	 *
+	 * Only the states between the first and the last node still alive are kept, and a column only
+	 * works out the states those can reach: up to the band of a left-to-right model further on, or
+	 * the whole rest of a model with a stroke shape while its first state is alive. A stroke
+	 * marker leaves just its forced state. The nodes that are worked out add the same terms as
+	 * Viterbi::Calculate_probability, so with threshold LOGZERO and no beam the scores are the
+	 * same. Models that can go back are worked out whole, but still given up.
+	 */
+	class BeamViterbi{
+		public:
+			static double Calculate_probability(const rh::Model &model, const vector<int> &observation, double threshold, rh::Beam &beam);
+		private:
+			static void calculateState(const double *previous, const rh::Model &model, int reach, int low, int j, double distribution, double *next);
+	};
+
+	Beam::Beam(double width){
+		this->width = width>0 ? width : 0;
+		decodes = 0;
+		cells = 0;
+		skipped = 0;
+		givenUp = 0;
+	}
+
+	double Beam::setting(){
+		return chosenSetting;
+	}
+
+	double Beam::chooseSetting(){
+		const char *wanted = getenv("RH_BEAM");
+		if(wanted!=NULL && wanted[0]!='\0'){
+			double width = atof(wanted);
+			return width>0 ? width : 0;
+		}
+		return -1;
+	}
+
+	//a normal frame of a left-to-right model, from the states from low on
+	void BeamViterbi::calculateState(const double *previous, const rh::Model &model, int reach, int low, int j, double distribution, double *next){
+		int stateNum = model.stateNum;
+		double best = previous[j]+model.bandTran[j];
+		for(int d=1; d<=reach && j-d>=low; d++){
+			double temp = previous[j-d]+model.bandTran[d*stateNum+j];
+			if(temp>best){
+				best = temp;
+			}
+		}
+		if(j>reach && low==0){//the first state of a model with a stroke shape reaches every state
+			double temp = previous[0]+model.transition(0, j);
+			if(temp>best){
+				best = temp;
+			}
+		}
+		next[j] = best+distribution;
+	}
+
+	double BeamViterbi::Calculate_probability(const rh::Model &model, const vector<int> &observation, double threshold, rh::Beam &beam){
+		int tranColumn = model.stateNum;
+		int matrixColumn = observation.size();
+		int firstSymbol = observation.at(0);
+		if(tranColumn==0){
+			return rh::LOGZERO;
+		}
+		beam.decodes++;
+		rh::Arena &arena = rh::Arena::local();
+		size_t arenaMark = arena.mark();
+		double *previous = arena.allocate<double>(tranColumn);
+		double *next = arena.allocate<double>(tranColumn);
+		//past the stroke band only the first state jumps on, and the band reaches the end otherwise
+		int reach = model.strokeStateNum>0 ? model.strokeJumpNo : model.bandWidth;
+
+		previous[0] = model.emission(firstSymbol)[0];
+		for(int j=1; j<tranColumn; j++){
+			previous[j] = rh::LOGZERO;
+		}
+		int low = 0;//the first and last states still alive
+		int high = 0;
+		beam.cells++;
+		beam.skipped += tranColumn-1;
+
+		int currentStrokeNum = 1;
+		for(int i=1; i<matrixColumn; i++){
+			int symbol = observation.at(i);
+			const double *distribution = model.emission(symbol);
+			int from, to;//the states worked out in this column
+			if(symbol>15||symbol<0){//only the first state of a stroke at its start, and the last state at its end
+				int forcedState;
+				if(symbol>15){
+					currentStrokeNum++;
+					forcedState = (currentStrokeNum-1)*rh::STATENO;
+				}else{
+					forcedState = currentStrokeNum*rh::STATENO-1;
+				}
+				from = forcedState;
+				to = forcedState<tranColumn ? forcedState : forcedState-1;
+				for(int j=0; j<tranColumn; j++){
+					next[j] = rh::LOGZERO;
+				}
+				if(forcedState<tranColumn){
+					Viterbi::calculateNode(previous, model, forcedState, distribution[forcedState], next, NULL);
+				}
+			}else if(model.leftToRight){
+				from = low;
+				to = low==0 && model.strokeStateNum>0 ? tranColumn-1 : high+reach;
+				if(to>tranColumn-1){
+					to = tranColumn-1;
+				}
+				for(int j=0; j<from; j++){
+					next[j] = rh::LOGZERO;
+				}
+				for(int j=from; j<=to; j++){
+					BeamViterbi::calculateState(previous, model, reach, low, j, distribution[j], next);
+				}
+				for(int j=to+1; j<tranColumn; j++){
+					next[j] = rh::LOGZERO;
+				}
+			}else{
+				from = 0;
+				to = tranColumn-1;
+				for(int j=0; j<tranColumn; j++){
+					Viterbi::calculateNode(previous, model, j, distribution[j], next, NULL);
+				}
+			}
+			beam.cells += to-from+1;
+			beam.skipped += tranColumn-(to-from+1);
+
+			//the best of the column, and the nodes within the beam of it
+			double best = rh::LOGZERO;
+			for(int j=from; j<=to; j++){
+				if(next[j]>best){
+					best = next[j];
+				}
+			}
+			if(!(best>threshold) || best==rh::LOGZERO){
+				beam.givenUp++;
+				beam.skipped += (long)(matrixColumn-1-i)*tranColumn;
+				arena.release(arenaMark);
+				return rh::LOGZERO;
+			}
+			double cutoff = beam.width>0 ? best-beam.width : rh::LOGZERO;
+			low = -1;
+			for(int j=from; j<=to; j++){
+				if(next[j]<cutoff){
+					next[j] = rh::LOGZERO;
+				}
+				if(next[j]!=rh::LOGZERO){
+					if(low<0){
+						low = j;
+					}
+					high = j;
+				}
+			}
+
+			double *swap = previous;
+			previous = next;
+			next = swap;
+		}
+
+		//it should always be ending at the last state.
+		double probability = previous[tranColumn-1];
+		arena.release(arenaMark);
+		return probability;
+	}
+
+	const double Beam::chosenSetting = Beam::chooseSetting();
+}
+
+#endif //__BeamViterbi__
@@ -0,0 +1,338 @@
+#ifndef __CompiledModels__
+#define __CompiledModels__
+
+#include <iostream>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "Constants.h"
+#include "Model.h"
+#include "ModelBank.h"
+#include "ReducedViterbi.h"
+#include "Viterbi.h"
+#include "ViterbiResult.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX//keep std::min and std::max usable
+#endif
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+namespace rh = redhat;
+using namespace std;
+
+namespace redhat{
+	//the score of one compiled model, as Viterbi::Calculate_probability
+	typedef double (*CompiledScore)(const int *observation, int length);
+
+	/* Score-only decoders generated for the models of one training run and built into a shared
+	 * library (compiledModels.dll, or .so), see compileModels.cpp. Each model gets a function of
+	 * its own with its log-probabilities as constants and its column written out state by state,
+	 * only the transitions that aren't zero, so there are no loops over the band left and nothing
+	 * to look up but the distribution of the symbol. The terms are the ones
+	 * Viterbi::Calculate_probability adds and compares, so the scores are the same.
+	 *
+	 * The library knows every model by its character and a fingerprint of its tables. A model
+	 * that isn't in the library, or was trained again after it was built, is scored by
+	 * Viterbi::Calculate_probability instead, and so is everything when there is no library or
+	 * RH_PRECISION asks for one of the reduced engines. Which function goes with which model is
+	 * worked out again whenever the bank scored has another revision than the last one.
+	 */
+	class CompiledModels{
+		public:
+			CompiledModels();
+			~CompiledModels();
+			bool load(string libraryPath);//false if there is no library to load
+			vector<rh::ViterbiResult> score(rh::ModelBank &bank, vector<int> &observation);
+			vector<rh::ViterbiResult> score(rh::ModelBank &bank, vector<int> &observation, const vector<bool> &candidates);//LOGZERO for the others
+			int compiled() const;//how many models of the last bank scored have a compiled function
+
+			static string fingerprint(const rh::Model &model);
+			static void generate(const vector<rh::Model> &models, const vector<string> &characters, ostream &source);
+			static string libraryName();
+		private:
+			void *library;
+			vector<string> characters;//the characters and fingerprints the library was built for
+			vector<string> fingerprints;
+			vector<rh::CompiledScore> functions;
+			vector<rh::CompiledScore> bankFunctions;//the function of each model of the bank, NULL for the generic engine
+			long bankRevision;//the revision of the bank bankFunctions is for
+
+			void attach(const rh::ModelBank &bank);
+			void *symbol(const char *name);
+
+			static string constant(double logProbability);
+			static string literal(const string &text);
+	};
+
+	typedef int (*CompiledCount)();
+	typedef const char *(*CompiledString)(int m);
+	typedef rh::CompiledScore (*CompiledFunction)(int m);
+
+	CompiledModels::CompiledModels(){
+		library = NULL;
+		bankRevision = -1;
+	}
+
+	CompiledModels::~CompiledModels(){
+		if(library!=NULL){
+#ifdef _WIN32
+			FreeLibrary((HMODULE)library);
+#else
+			dlclose(library);
+#endif
+		}
+	}
+
+	string CompiledModels::libraryName(){
+#ifdef _WIN32
+		return "compiledModels.dll";
+#else
+		return "compiledModels.so";
+#endif
+	}
+
+	void *CompiledModels::symbol(const char *name){
+#ifdef _WIN32
+		return (void *)GetProcAddress((HMODULE)library, name);
+#else
+		return dlsym(library, name);
+#endif
+	}
+
+	bool CompiledModels::load(string libraryPath){
+#ifdef _WIN32
+		library = (void *)LoadLibraryA(libraryPath.c_str());
+#else
+		library = dlopen(libraryPath.c_str(), RTLD_NOW);
+#endif
+		if(library==NULL){
+			return false;
+		}
+		CompiledCount count = (CompiledCount)CompiledModels::symbol("rh_compiled_count");
+		CompiledString character = (CompiledString)CompiledModels::symbol("rh_compiled_character");
+		CompiledString fingerprint = (CompiledString)CompiledModels::symbol("rh_compiled_fingerprint");
+		CompiledFunction function = (CompiledFunction)CompiledModels::symbol("rh_compiled_function");
+		if(count==NULL||character==NULL||fingerprint==NULL||function==NULL){
+			cout<<"Cannot read the compiled models.\n";
+			return false;
+		}
+		for(int m=0; m<count(); m++){
+			characters.push_back(character(m));
+			fingerprints.push_back(fingerprint(m));
+			functions.push_back(function(m));
+		}
+		bankRevision = -1;
+		return true;
+	}
+
+	//which models of the bank the library has, by character, as long as their tables haven't changed
+	void CompiledModels::attach(const rh::ModelBank &bank){
+		bankFunctions.assign(bank.models.size(), (rh::CompiledScore)NULL);
+		for(int m=0; m<bank.models.size(); m++){
+			for(int c=0; c<characters.size(); c++){
+				if(characters[c].compare(bank.characters[m])==0){
+					if(fingerprints[c].compare(CompiledModels::fingerprint(bank.models[m]))==0){
+						bankFunctions[m] = functions[c];
+					}
+					break;
+				}
+			}
+		}
+		bankRevision = bank.revision;
+	}
+
+	int CompiledModels::compiled() const{
+		int count = 0;
+		for(int m=0; m<bankFunctions.size(); m++){
+			if(bankFunctions[m]!=NULL){
+				count++;
+			}
+		}
+		return count;
+	}
+
+	vector<rh::ViterbiResult> CompiledModels::score(rh::ModelBank &bank, vector<int> &observation){
+		return CompiledModels::score(bank, observation, vector<bool>(bank.models.size(), true));
+	}
+
+	vector<rh::ViterbiResult> CompiledModels::score(rh::ModelBank &bank, vector<int> &observation, const vector<bool> &candidates){
+		if(library==NULL || observation.size()==0 || rh::ReducedViterbi::precision().compare("double")!=0){
+			return bank.score(observation, candidates);
+		}
+		if(bankRevision!=bank.revision){
+			CompiledModels::attach(bank);
+		}
+		vector<rh::ViterbiResult> results(bank.models.size());
+		for(int m=0; m<bank.models.size(); m++){
+			results[m].character = bank.characters[m];
+			if(!candidates[m]){
+				results[m].probability = rh::LOGZERO;
+			}else if(bankFunctions[m]!=NULL){
+				results[m].probability = bankFunctions[m](&observation[0], observation.size());
+			}else{//added after the library was built
+				results[m].probability = rh::Viterbi::Calculate_probability(bank.models[m], observation);
+			}
+		}
+		return results;
+	}
+
+	//FNV-1a over the size and the log-probabilities of the model
+	string CompiledModels::fingerprint(const rh::Model &model){
+		unsigned long long hash = 14695981039346656037ULL;
+		vector<double> tables(1, (double)model.stateNum);
+		tables.insert(tables.end(), model.logDis.begin(), model.logDis.end());
+		tables.insert(tables.end(), model.logTran.begin(), model.logTran.end());
+		const unsigned char *bytes = (const unsigned char *)&tables[0];
+		for(int i=0; i<tables.size()*sizeof(double); i++){
+			hash ^= bytes[i];
+			hash *= 1099511628211ULL;
+		}
+		char text[17];
+		sprintf(text, "%08x%08x", (unsigned int)(hash>>32), (unsigned int)(hash&0xffffffffu));
+		return text;
+	}
+
+	//a log-probability as a C++ literal that reads back to the same double
+	string CompiledModels::constant(double logProbability){
+		if(logProbability==rh::LOGZERO){
+			return "Z";
+		}
+		char text[32];
+		sprintf(text, "%.17g", logProbability);
+		return text;
+	}
+
+	//text as a C++ string literal: a character is named after its directory, which may hold a quote
+	//or a backslash, a ? that starts a trigraph, or a control character that would end the line,
+	//which goes in as an octal escape
+	string CompiledModels::literal(const string &text){
+		string quoted = "\"";
+		for(int i=0; i<text.size(); i++){
+			unsigned char c = text[i];
+			if(c=='"' || c=='\\' || c=='?'){
+				quoted += '\\';
+				quoted += c;
+			}else if(c<0x20 || c==0x7f){
+				char escape[8];
+				sprintf(escape, "\\%03o", c);
+				quoted += escape;
+			}else{
+				quoted += c;
+			}
+		}
+		return quoted+"\"";
+	}
+
+	/* The source of the library: one function per model and the four functions load looks up.
+	 * A normal column works out every state from the states with a transition into it, in the
+	 * order ViterbiKernel tries them; a start or end of stroke works out only its forced state,
+	 * like Viterbi::calculateNode.
+	 */
+	void CompiledModels::generate(const vector<rh::Model> &models, const vector<string> &characters, ostream &source){
+		source<<"//generated by compileModels from the optimised models, build it into a shared library"<<endl;
+		source<<"#include <math.h>"<<endl<<endl;
+		source<<"#ifdef _WIN32"<<endl<<"#define RH_EXPORT extern \"C\" __declspec(dllexport)"<<endl;
+		source<<"#else"<<endl<<"#define RH_EXPORT extern \"C\""<<endl<<"#endif"<<endl<<endl;
+		source<<"static const double Z = -HUGE_VAL;"<<endl<<endl;
+		source<<"typedef double (*Score)(const int *observation, int length);"<<endl<<endl;
+		source<<"static int direction(int symbol){"<<endl;
+		source<<"\treturn symbol>15 ? symbol-16 : (symbol<0 ? symbol+16 : symbol);"<<endl<<"}"<<endl<<endl;
+
+		for(int m=0; m<models.size(); m++){
+			const rh::Model &model = models[m];
+			int stateNum = model.stateNum;
+			source<<"//"<<CompiledModels::literal(characters[m])<<", "<<stateNum<<" states"<<endl;//a name ending in a backslash would carry the comment on
+			source<<"static double model"<<m<<"(const int *observation, int length){"<<endl;
+			if(stateNum==0){
+				source<<"\treturn Z;"<<endl<<"}"<<endl<<endl;
+				continue;
+			}
+			source<<"\tstatic const double dis["<<16*stateNum<<"] = {";
+			for(int i=0; i<16*stateNum; i++){
+				source<<(i%stateNum==0 ? "\n\t\t" : " ")<<CompiledModels::constant(model.symbolDis[i])<<",";
+			}
+			source<<endl<<"\t};"<<endl;
+			source<<"\tdouble columns["<<2*stateNum<<"];"<<endl;
+			source<<"\tdouble *previous = columns;"<<endl;
+			source<<"\tdouble *next = columns+"<<stateNum<<";"<<endl;
+			source<<"\tdouble best, temp;"<<endl;
+			source<<"\tprevious[0] = dis[direction(observation[0])*"<<stateNum<<"];"<<endl;
+			source<<"\tfor(int j=1; j<"<<stateNum<<"; j++){"<<endl<<"\t\tprevious[j] = Z;"<<endl<<"\t}"<<endl;
+			source<<"\tint currentStrokeNum = 1;"<<endl;
+			source<<"\tfor(int i=1; i<length; i++){"<<endl;
+			source<<"\t\tint symbol = observation[i];"<<endl;
+			source<<"\t\tconst double *distribution = dis+direction(symbol)*"<<stateNum<<";"<<endl;
+			source<<"\t\tint forcedState = -1;"<<endl;
+			source<<"\t\tif(symbol>15){"<<endl<<"\t\t\tcurrentStrokeNum++;"<<endl;
+			source<<"\t\t\tforcedState = (currentStrokeNum-1)*"<<rh::STATENO<<";"<<endl;
+			source<<"\t\t}else if(symbol<0){"<<endl;
+			source<<"\t\t\tforcedState = currentStrokeNum*"<<rh::STATENO<<"-1;"<<endl<<"\t\t}"<<endl;
+			source<<"\t\tif(forcedState>=0){"<<endl;
+			source<<"\t\t\tfor(int j=0; j<"<<stateNum<<"; j++){"<<endl<<"\t\t\t\tnext[j] = Z;"<<endl<<"\t\t\t}"<<endl;
+			source<<"\t\t}"<<endl;
+			//every state is a case of the switch for the forced state, and the normal column falls through all of them
+			source<<"\t\tswitch(forcedState){"<<endl;
+			source<<"\t\t\tcase -1:"<<endl;
+			for(int j=0; j<stateNum; j++){
+				source<<"\t\t\tcase "<<j<<":"<<endl;
+				vector<int> from;//nearest first, then the states after j of a model that goes back
+				for(int k=j; k>=0; k--){
+					from.push_back(k);
+				}
+				for(int k=j+1; k<stateNum; k++){
+					from.push_back(k);
+				}
+				bool first = true;
+				for(int f=0; f<from.size(); f++){
+					int k = from[f];
+					double transition = model.transition(k, j);
+					if(transition==rh::LOGZERO){
+						continue;
+					}
+					if(first){
+						source<<"\t\t\t\tbest = previous["<<k<<"]+"<<CompiledModels::constant(transition)<<";"<<endl;
+						first = false;
+					}else{
+						source<<"\t\t\t\ttemp = previous["<<k<<"]+"<<CompiledModels::constant(transition)<<"; if(temp>best) best = temp;"<<endl;
+					}
+				}
+				if(first){
+					source<<"\t\t\t\tnext["<<j<<"] = Z;"<<endl;
+				}else{
+					source<<"\t\t\t\tnext["<<j<<"] = best+distribution["<<j<<"];"<<endl;
+				}
+				source<<"\t\t\t\tif(forcedState>=0) break;"<<endl;
+			}
+			source<<"\t\t}"<<endl;
+			source<<"\t\tdouble *swap = previous;"<<endl<<"\t\tprevious = next;"<<endl<<"\t\tnext = swap;"<<endl;
+			source<<"\t}"<<endl;
+			source<<"\treturn previous["<<stateNum-1<<"];"<<endl<<"}"<<endl<<endl;
+		}
+
+		source<<"static const char *characters[] = {";
+		for(int m=0; m<models.size(); m++){
+			source<<CompiledModels::literal(characters[m])<<", ";
+		}
+		source<<"0};"<<endl;
+		source<<"static const char *fingerprints[] = {";
+		for(int m=0; m<models.size(); m++){
+			source<<CompiledModels::literal(CompiledModels::fingerprint(models[m]))<<", ";
+		}
+		source<<"0};"<<endl;
+		source<<"static const Score functions[] = {";
+		for(int m=0; m<models.size(); m++){
+			source<<"model"<<m<<", ";
+		}
+		source<<"0};"<<endl<<endl;
+		source<<"RH_EXPORT int rh_compiled_count(){"<<endl<<"\treturn "<<models.size()<<";"<<endl<<"}"<<endl<<endl;
+		source<<"RH_EXPORT const char *rh_compiled_character(int m){"<<endl<<"\treturn characters[m];"<<endl<<"}"<<endl<<endl;
+		source<<"RH_EXPORT const char *rh_compiled_fingerprint(int m){"<<endl<<"\treturn fingerprints[m];"<<endl<<"}"<<endl<<endl;
+		source<<"RH_EXPORT Score rh_compiled_function(int m){"<<endl<<"\treturn functions[m];"<<endl<<"}"<<endl;
+	}
+}
+
+#endif //__CompiledModels__
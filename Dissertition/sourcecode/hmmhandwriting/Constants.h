@@ -1,8 +1,18 @@
+#ifndef __CONSTANTS__
+#define __CONSTANTS__
+
 #include <iostream>
+#include <limits>
 
 using namespace std;
 
 namespace redhat{
 	const int STATENO = 5;
 	const int JUMPNO = 3;
-}
\ No newline at end of file
+	//the stroke shapes (states per stroke, furthest jump) StrokeViterbi has a decoder for
+	const int SHAPENO = 3;
+	const int SHAPES[SHAPENO][2] = {{3, 2}, {5, 3}, {8, 4}};
+	const double LOGZERO = -numeric_limits<double>::infinity();//log(0), the score of an impossible transition or node
+}
+
+#endif //__CONSTANTS__
\ No newline at end of file
@@ -0,0 +1,45 @@
+#ifndef __DecoderWorkspace__
+#define __DecoderWorkspace__
+
+#include <iostream>
+#include <vector>
+#include "Arena.h"
+
+using namespace std;
+
+namespace redhat{
+	/* Everything Viterbi::decode needs besides the model and the observation, owned by the caller
+	 * and kept between decodes. The score columns and the packed backpointers come from the arena
+	 * and the state path is written into path, both of which only ever grow, so once the workspace
+	 * has seen the longest observation and the largest model a decode makes no heap allocations.
+	 * A workspace must not be shared by two threads at once.
+	 */
+	class DecoderWorkspace{
+		public:
+			vector<int> path;//the state path of the last decode
+			double probability;//and its probability
+			Arena arena;
+
+			DecoderWorkspace();
+
+			static DecoderWorkspace &local();//one workspace per thread, for the decoders that return a ViterbiResult
+			static void releaseLocal();//free the calling thread's workspace, see ThreadLocal
+		private:
+			DecoderWorkspace(const DecoderWorkspace &);
+			DecoderWorkspace &operator=(const DecoderWorkspace &);
+	};
+
+	DecoderWorkspace::DecoderWorkspace(){
+		probability=0;
+	}
+
+	DecoderWorkspace &DecoderWorkspace::local(){
+		return ThreadLocal<DecoderWorkspace>::get();
+	}
+
+	void DecoderWorkspace::releaseLocal(){
+		ThreadLocal<DecoderWorkspace>::release();
+	}
+}
+
+#endif //__DecoderWorkspace__
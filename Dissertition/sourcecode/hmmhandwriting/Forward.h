@@ -0,0 +1,240 @@
+#ifndef __Forward__
+#define __Forward__
+
+#include <iostream>
+#include <math.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "Arena.h"
+#include "Constants.h"
+#include "Model.h"
+#include "ViterbiKernel.h"
+
+namespace rh = redhat;
+using namespace std;
+
+namespace redhat{
+	/* The tables of a Model as plain probabilities, for the forward algorithm. The log-probabilities
+	 * of the model are turned back with exp once, and LOGZERO becomes 0. reach is how far back the
+	 * band of a state has to look, the model's jumpWidth: further back nothing goes into a state
+	 * but the transition out of the first state, which is kept apart in fromFirst. The trained
+	 * models' first state reaches every state, and with it in the band a column would cost
+	 * O(stateNum^2) rather than O(stateNum*(reach+2)).
+	 */
+	class ForwardModel{
+		public:
+			int stateNum;
+			int reach;
+			bool leftToRight;
+			vector<int> bandStart;
+			vector<int> bandEnd;
+			vector<double> symbolDis;//symbolDis[symbol*stateNum+state], as in Model
+			vector<double> tran;//tran[from*stateNum+to]
+			vector<double> bandTran;//bandTran[d*stateNum+to] for d up to reach
+			vector<double> fromFirst;//the transition out of the first state into states past reach, 0 for the others
+
+			ForwardModel();
+			void set(const rh::Model &model);
+	};
+
+	/* Score-only forward algorithm: the log of the probability of the observation summed over every
+	 * path, rather than the best one. The recursion is Viterbi::Calculate_probability's with the max
+	 * turned into a sum, stroke markers included, so a start or end of stroke still only leaves
+	 * its forced state. To stay clear of log and exp in every node it works on scaled
+	 * probabilities: each column is divided by its sum, and the logs of the sums are added up on
+	 * the side, which is the only log a column costs. A normal frame of a left-to-right model is a
+	 * sum of products over the same band as ViterbiKernel, 4 states at a time with AVX2; the vector
+	 * and scalar columns add the terms in the same order and so give the same result.
+	 * RH_RANKING=forward has recognise rank the characters by it instead of by the best path.
+	 */
+	class Forward{
+		public:
+			static double Calculate_probability(const rh::ForwardModel &model, const vector<int> &observation);
+			static string ranking();//viterbi or forward, from RH_RANKING, picked once
+		private:
+			static void calculateNode(const double *previous, const rh::ForwardModel &model, int j, double distribution, double *next);
+			static void calculateColumn(const double *previous, const rh::ForwardModel &model, const double *distribution, double *next, int from, int to);
+#ifdef RH_X86
+			static void avx2Column(const double *previous, const rh::ForwardModel &model, const double *distribution, double *next);
+#endif
+			static bool useAvx2();
+			static string chooseRanking();
+			static const string chosenRanking;//read before main, never from a decoder thread
+	};
+
+	ForwardModel::ForwardModel(){
+		stateNum=0;
+		reach=0;
+		leftToRight=true;
+	}
+
+	void ForwardModel::set(const rh::Model &model){
+		stateNum = model.stateNum;
+		leftToRight = model.leftToRight;
+		reach = model.jumpWidth;
+		bandStart = model.bandStart;
+		bandEnd = model.bandEnd;
+		symbolDis.resize(model.symbolDis.size());
+		for(int i=0; i<model.symbolDis.size(); i++){
+			symbolDis[i] = exp(model.symbolDis[i]);
+		}
+		tran.resize(model.logTran.size());
+		for(int i=0; i<model.logTran.size(); i++){
+			tran[i] = exp(model.logTran[i]);
+		}
+		bandTran.assign((reach+1)*stateNum, 0);
+		for(int d=0; d<=reach && d<=model.bandWidth; d++){
+			for(int j=d; j<stateNum; j++){
+				bandTran[d*stateNum+j] = exp(model.bandTran[d*stateNum+j]);
+			}
+		}
+		fromFirst.assign(stateNum, 0);
+		for(int j=reach+1; j<stateNum; j++){
+			fromFirst[j] = tran[j];
+		}
+	}
+
+	//a forced state at the start or end of a stroke, or a state of a model that goes back
+	void Forward::calculateNode(const double *previous, const rh::ForwardModel &model, int j, double distribution, double *next){
+		double sum = 0;
+		for(int k=model.bandStart[j]; k<=model.bandEnd[j]; k++){
+			sum += previous[k]*model.tran[k*model.stateNum+j];
+		}
+		next[j] = sum*distribution;
+	}
+
+	//states from..to-1 of a normal frame of a left-to-right model, nearest term first
+	void Forward::calculateColumn(const double *previous, const rh::ForwardModel &model, const double *distribution, double *next, int from, int to){
+		int stateNum = model.stateNum;
+		const double *bandTran = &model.bandTran[0];
+		for(int j=from; j<to; j++){
+			double sum = previous[j]*bandTran[j];
+			for(int d=1; d<=model.reach && d<=j; d++){
+				sum += previous[j-d]*bandTran[d*stateNum+j];
+			}
+			sum += previous[0]*model.fromFirst[j];
+			next[j] = sum*distribution[j];
+		}
+	}
+
+#ifdef RH_X86
+	RH_TARGET("avx2")
+	void Forward::avx2Column(const double *previous, const rh::ForwardModel &model, const double *distribution, double *next){
+		int stateNum = model.stateNum;
+		const double *bandTran = &model.bandTran[0];
+		int from = model.reach<stateNum ? model.reach : stateNum;
+		Forward::calculateColumn(previous, model, distribution, next, 0, from);
+		__m256d first = _mm256_set1_pd(previous[0]);
+		int j=from;
+		for(; j+4<=stateNum; j+=4){
+			__m256d sum = _mm256_mul_pd(_mm256_loadu_pd(previous+j), _mm256_loadu_pd(bandTran+j));
+			for(int d=1; d<=model.reach; d++){
+				sum = _mm256_add_pd(sum, _mm256_mul_pd(_mm256_loadu_pd(previous+j-d), _mm256_loadu_pd(bandTran+d*stateNum+j)));
+			}
+			sum = _mm256_add_pd(sum, _mm256_mul_pd(first, _mm256_loadu_pd(&model.fromFirst[j])));
+			_mm256_storeu_pd(next+j, _mm256_mul_pd(sum, _mm256_loadu_pd(distribution+j)));
+		}
+		_mm256_zeroupper();//gcc leaves the upper halves dirty for the sse code of the tail, which then runs 4 times slower
+		Forward::calculateColumn(previous, model, distribution, next, j, stateNum);
+	}
+#endif
+
+	double Forward::Calculate_probability(const rh::ForwardModel &model, const vector<int> &observation){
+		int tranColumn = model.stateNum;
+		int firstSymbol = rh::Model::direction(observation.at(0));
+		if(tranColumn==0){
+			return rh::LOGZERO;
+		}
+		rh::Arena &arena = rh::Arena::local();
+		size_t arenaMark = arena.mark();
+		double *previous = arena.allocate<double>(tranColumn);
+		double *next = arena.allocate<double>(tranColumn);
+		bool avx2 = Forward::useAvx2();
+		double logScale = 0;//the log of what the columns have been divided by so far
+
+		previous[0] = model.symbolDis[firstSymbol*tranColumn];
+		for(int j=1; j<tranColumn; j++){
+			previous[j] = 0;
+		}
+
+		int currentStrokeNum = 1;
+		for(int i=0; i<observation.size(); i++){
+			if(i>0){
+				int symbol = observation.at(i);
+				const double *distribution = &model.symbolDis[rh::Model::direction(symbol)*tranColumn];
+				if(symbol>15||symbol<0){//only the first state of a stroke at its start, and the last state at its end
+					int forcedState;
+					if(symbol>15){
+						currentStrokeNum++;
+						forcedState = (currentStrokeNum-1)*rh::STATENO;
+					}else{
+						forcedState = currentStrokeNum*rh::STATENO-1;
+					}
+					for(int j=0; j<tranColumn; j++){
+						next[j] = 0;
+					}
+					if(forcedState<tranColumn){
+						Forward::calculateNode(previous, model, forcedState, distribution[forcedState], next);
+					}
+				}else if(model.leftToRight){
+#ifdef RH_X86
+					if(avx2){
+						Forward::avx2Column(previous, model, distribution, next);
+					}else
+#endif
+					Forward::calculateColumn(previous, model, distribution, next, 0, tranColumn);
+				}else{
+					for(int j=0; j<tranColumn; j++){
+						Forward::calculateNode(previous, model, j, distribution[j], next);
+					}
+				}
+				double *swap = previous;
+				previous = next;
+				next = swap;
+			}
+			//scale the column to add up to 1
+			double sum = 0;
+			for(int j=0; j<tranColumn; j++){
+				sum += previous[j];
+			}
+			if(sum==0){//nothing can be reached any more
+				arena.release(arenaMark);
+				return rh::LOGZERO;
+			}
+			double scale = 1/sum;
+			for(int j=0; j<tranColumn; j++){
+				previous[j] *= scale;
+			}
+			logScale += log(sum);
+		}
+
+		//it should always be ending at the last state.
+		double probability = previous[tranColumn-1]==0 ? rh::LOGZERO : logScale+log(previous[tranColumn-1]);
+		arena.release(arenaMark);
+		return probability;
+	}
+
+	bool Forward::useAvx2(){
+		return ViterbiKernel::hasAvx2();
+	}
+
+	string Forward::ranking(){
+		return chosenRanking;
+	}
+
+	string Forward::chooseRanking(){
+		const char *wanted = getenv("RH_RANKING");
+		if(wanted!=NULL){
+			string ranking = wanted;
+			if(ranking.compare("forward")==0){
+				return ranking;
+			}
+		}
+		return "viterbi";
+	}
+
+	const string Forward::chosenRanking = Forward::chooseRanking();
+}
+
+#endif //__Forward__
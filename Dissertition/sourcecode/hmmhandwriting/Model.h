@@ -0,0 +1,232 @@
+#ifndef __MODEL__
+#define __MODEL__
+
+#include <iostream>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/path.hpp>
+#include "Constants.h"
+#include "convert.h"
+
+namespace rh = redhat;
+namespace fs = boost::filesystem;
+using namespace std;
+
+namespace redhat{
+	/* A character model read from the _dis.txt and _tran.txt files.
+	 * The probabilities are turned into log-probabilities once when the files are loaded,
+	 * so the decoder only has to add and compare.
+	 */
+	class Model{
+		public:
+			int stateNum;//number of states, the transition matrix is stateNum*stateNum
+			vector<double> logDis;//logDis[state*16+symbol]
+			vector<double> symbolDis;//symbolDis[symbol*stateNum+state], the same a symbol at a time
+			vector<double> logTran;//logTran[from*stateNum+to]
+			vector<int> bandStart;//first state with a non-zero transition into each state
+			vector<int> bandEnd;//last state with a non-zero transition into each state
+			bool leftToRight;//no transition goes back to an earlier state
+			int bandWidth;//the furthest jump into any state
+			int jumpWidth;//the furthest jump into any state from a state other than the first
+			vector<double> bandTran;//bandTran[d*stateNum+to] = logTran[(to-d)*stateNum+to], LOGZERO before the first state
+			int strokeStateNum;//the shape out of SHAPES the model has, 0 if none
+			int strokeJumpNo;
+			int strokeNum;//the strokes the model is for, stateNum/STATENO, 0 if that isn't whole
+
+			Model();
+			void load(string distributionProbabilityFilePath, string transitionProbabilityFilePath);
+			void set(const vector<double> &disProb, const vector< vector<double> > &tranProb);
+			double distribution(int state, int symbol) const;
+			const double *emission(int symbol) const;
+			double transition(int from, int to) const;
+			bool hasShape(int stateNo, int jumpNo) const;
+
+			static double logProbability(double probability);
+			static int direction(int symbol);
+	};
+
+	Model::Model(){
+		stateNum=0;
+		leftToRight=true;
+		bandWidth=0;
+		jumpWidth=0;
+		strokeStateNum=0;
+		strokeJumpNo=0;
+		strokeNum=0;
+	}
+
+	void Model::load(string distributionProbabilityFilePath, string transitionProbabilityFilePath){
+		vector<double> disProb;
+		vector< vector<double> > tranProb;
+
+		string line;//used to retrieve each line in a file
+
+		fs::ifstream disProbFile(distributionProbabilityFilePath);
+		if(!disProbFile){
+			cout<<"Cannot open file.\n";
+		}else{
+			while(!disProbFile.eof()){
+				getline(disProbFile, line);
+				if(line.compare("")==0){//do nothing
+				}else{
+					disProb.push_back(rh::convertToDouble(line));
+				}
+			}
+		}
+		disProbFile.close();
+
+		fs::ifstream tranProbFile(transitionProbabilityFilePath);
+		if(!tranProbFile){
+			cout<<"Cannot open file.\n";
+		}else{
+			tranProb.push_back(vector<double>());
+			while(!tranProbFile.eof()){
+				getline(tranProbFile, line);
+				if(line.compare("newRow")==0){
+					tranProb.push_back(vector<double>());
+				}else if(line.compare("")==0){// do nothing
+				}else{
+					tranProb.back().push_back(rh::convertToDouble(line));
+				}
+			}
+		}
+		tranProbFile.close();
+
+		Model::set(disProb, tranProb);
+	}
+
+	//the tables from the probabilities as they are in the files: disProb[state*16+symbol], tranProb[from][to]
+	void Model::set(const vector<double> &disProb, const vector< vector<double> > &tranProb){
+		//the number of states is the length of the last row, as it was for the old 2D arrays
+		stateNum = tranProb.size()==0 ? 0 : tranProb.back().size();
+
+		logDis.assign(stateNum*16, rh::LOGZERO);
+		for(int i=0; i<stateNum*16 && i<disProb.size(); i++){
+			logDis[i] = Model::logProbability(disProb[i]);
+		}
+
+		//the decoder wants the scores of every state for one symbol, in a row
+		symbolDis.assign(16*stateNum, rh::LOGZERO);
+		for(int j=0; j<stateNum; j++){
+			for(int k=0; k<16; k++){
+				symbolDis[k*stateNum+j] = logDis[j*16+k];
+			}
+		}
+
+		logTran.assign(stateNum*stateNum, rh::LOGZERO);
+		for(int k=0; k<stateNum && k<tranProb.size(); k++){
+			for(int j=0; j<stateNum && j<tranProb[k].size(); j++){
+				logTran[k*stateNum+j] = Model::logProbability(tranProb[k][j]);
+			}
+		}
+
+		//work out the band of each state: in a left-to-right model only the JUMPNO states before j
+		//(including the hand-off from the last state of the previous stroke) have a non-zero transition into j
+		bandStart.assign(stateNum, stateNum);
+		bandEnd.assign(stateNum, -1);
+		for(int j=0; j<stateNum; j++){
+			for(int k=0; k<stateNum; k++){
+				if(logTran[k*stateNum+j]!=rh::LOGZERO){
+					if(bandStart[j]==stateNum) bandStart[j]=k;
+					bandEnd[j]=k;
+				}
+			}
+		}
+		
+		//lay the band out jump by jump so a whole column of states can be worked out together
+		leftToRight=true;
+		bandWidth=0;
+		for(int j=0; j<stateNum; j++){
+			if(bandEnd[j]>j) leftToRight=false;
+			if(bandEnd[j]>=0 && j-bandStart[j]>bandWidth) bandWidth=j-bandStart[j];
+		}
+		//the first state's row usually reaches every state, leave it out
+		jumpWidth=0;
+		for(int j=0; j<stateNum; j++){
+			for(int k=1; k<j-jumpWidth; k++){
+				if(logTran[k*stateNum+j]!=rh::LOGZERO){
+					jumpWidth=j-k;
+					break;
+				}
+			}
+		}
+		bandTran.assign((bandWidth+1)*stateNum, rh::LOGZERO);
+		for(int d=0; d<=bandWidth; d++){
+			for(int j=d; j<stateNum; j++){
+				bandTran[d*stateNum+j] = logTran[(j-d)*stateNum+j];
+			}
+		}
+		
+		strokeStateNum=0;
+		strokeJumpNo=0;
+		for(int i=0; i<rh::SHAPENO; i++){
+			if(Model::hasShape(rh::SHAPES[i][0], rh::SHAPES[i][1])){
+				strokeStateNum = rh::SHAPES[i][0];
+				strokeJumpNo = rh::SHAPES[i][1];
+				break;
+			}
+		}
+
+		//the stroke markers force stroke s into states (s-1)*STATENO to s*STATENO-1 whatever the shape
+		strokeNum = stateNum>0 && stateNum%rh::STATENO==0 ? stateNum/rh::STATENO : 0;
+	}
+
+	double Model::distribution(int state, int symbol) const{
+		return logDis[state*16+symbol];
+	}
+
+	//the distribution of every state for an observation, markers included
+	const double *Model::emission(int symbol) const{
+		return &symbolDis[Model::direction(symbol)*stateNum];
+	}
+
+	double Model::transition(int from, int to) const{
+		return logTran[from*stateNum+to];
+	}
+
+	/* Whether the model is made of strokes of stateNo states the way quantilise writes them: a
+	 * state is reached from itself and the jumpNo states before it in its stroke, the first state
+	 * of a stroke also from the last state of the stroke before, and any state from the first state.
+	 */
+	bool Model::hasShape(int stateNo, int jumpNo) const{
+		if(stateNum==0 || stateNum%stateNo!=0 || !leftToRight || bandWidth<jumpNo){
+			return false;
+		}
+		for(int k=0; k<stateNum; k++){
+			for(int j=0; j<stateNum; j++){
+				if(logTran[k*stateNum+j]==rh::LOGZERO || k==0){
+					continue;
+				}
+				int d = j-k;
+				bool inStroke = d>=0 && d<=jumpNo && d<=j%stateNo;
+				bool handOff = d==1 && j%stateNo==0;
+				if(!inStroke && !handOff){
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	double Model::logProbability(double probability){
+		if(probability==0){
+			return rh::LOGZERO;
+		}
+		return log(probability);
+	}
+
+	//the direction of an observation: quantilise writes the start of a stroke as direction+16 and the end as direction-16
+	int Model::direction(int symbol){
+		if(symbol>15){
+			return symbol-16;
+		}else if(symbol<0){
+			return symbol+16;
+		}
+		return symbol;
+	}
+}
+
+#endif //__MODEL__
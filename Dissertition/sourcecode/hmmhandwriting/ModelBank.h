@@ -0,0 +1,546 @@
+#ifndef __ModelBank__
+#define __ModelBank__
+
+#include <iostream>
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <math.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "Arena.h"
+#include "BeamViterbi.h"
+#include "Constants.h"
+#include "Forward.h"
+#include "Model.h"
+#include "Prefilter.h"
+#include "Ranking.h"
+#include "ReducedViterbi.h"
+#include "RunLength.h"
+#include "RunViterbi.h"
+#include "Viterbi.h"
+#include "ViterbiKernel.h"
+#include "ViterbiResult.h"
+
+//cl before VS2013 only has the underscored one
+#if defined(_MSC_VER) && _MSC_VER<1800
+#include <float.h>
+#define RH_NEXTAFTER _nextafter
+#else
+#define RH_NEXTAFTER nextafter
+#endif
+
+namespace rh = redhat;
+using namespace std;
+
+namespace redhat{
+	/* Every character model packed into one structure-of-arrays layout, so an observation can be
+	 * scored against all of them in a single pass. The states of all models sit side by side in
+	 * one column, each model starting on a multiple of LANES, and the band transitions of the
+	 * bank are the band transitions of each model with LOGZERO across model boundaries. A normal
+	 * frame is then one run of the column kernel over each group of the bank. Like
+	 * Viterbi::Calculate_probability it keeps two columns of scores and no backpointers.
+	 * The models are indexed by the number of strokes they are for, and the models of one stroke
+	 * count are packed next to each other with band transitions of their own, so a group can be
+	 * left out of the pass. An observation forces its strokes onto the states of a model, and a
+	 * model for a different number of strokes can only end at LOGZERO, so candidates() lets
+	 * through the models with the observation's stroke count, give or take RH_STROKE_TOLERANCE,
+	 * and the score functions only decode those. RH_STROKE_TOLERANCE=all decodes every model.
+	 * scoreBeam decodes the models one after the other instead, each with the score of the
+	 * nBest-th best model so far as the threshold to give it up at, see BeamViterbi.
+	 *
+	 * scoreBound finds the same nBest best without decoding every model. bound() is at least the
+	 * score of any path of a model: the first emission, then for every other frame the best a
+	 * state the frame allows can add, the best transition into it plus its emission of the
+	 * symbol, worked out per state and per symbol when the bank is packed. The models are decoded
+	 * from the highest bound down, and once the nBest-th best score is above the bound of the next
+	 * model none of the rest can get in. The models are decoded a stroke at a time with RunViterbi,
+	 * and one is given up at a stroke marker once its score so far plus remainingBound() of the
+	 * rest of the observation can't make the nBest. It never uses a beam inside the trellis, so the
+	 * nBest are always those of decoding every model, RH_BEAM or not. RH_SEARCH=bound has recognise use it.
+	 * A deployment that sets RH_PRECISION to float or int16 scores each model with
+	 * ReducedViterbi instead. scoreForward gives every model the likelihood of the observation
+	 * over all of its paths, see Forward.
+	 */
+	class ModelBank{
+		public:
+			static const int LANES = 8;//widest kernel is 8 doubles
+
+			vector<rh::Model> models;
+			vector<string> characters;
+			vector<int> offset;//first state of each model in the bank
+			int stateNum;//states in the bank including padding
+			int bandWidth;
+			vector<double> bandTran;//each group laid out as in Model from (bandWidth+1)*groupStart[g] on, groupStart[g+1]-groupStart[g] states to a row
+			vector<double> fromFirst;//transitions out of the first state of each model that the band doesn't reach
+			vector<double> symbolDis;//symbolDis[symbol*stateNum+state], as in Model
+			vector<rh::ReducedModel> reducedModels;//the models for the float and int16 engines
+			vector<rh::ForwardModel> forwardModels;
+			rh::Prefilter prefilter;//the direction signatures of the models
+			map< int, vector<int> > strokeIndex;//the models for each number of strokes, 0 for the models whose states aren't whole strokes
+			vector<int> groupStrokeNum;//the stroke count of each group of the bank, fewest first
+			vector<int> groupStart;//first state of each group, and the end of the bank last
+			vector<double> intoBound;//the best transition into every state of the bank
+			vector<double> stepBound;//stepBound[m*16+symbol] the most a normal frame with symbol adds to model m
+			long revision;//new with every model added, and no other bank in the process has it: what was worked out for a bank holds while it stays
+
+			ModelBank();
+			void add(string character, string distributionProbabilityFilePath, string transitionProbabilityFilePath);
+			void add(string character, const rh::Model &model);
+			void pack();
+			vector<bool> candidates(const vector<int> &observation, int tolerance);//tolerance<0 for every model
+			vector<rh::ViterbiResult> score(vector<int> &observation);
+			vector<rh::ViterbiResult> score(vector<int> &observation, const vector<bool> &candidates);//LOGZERO for the others
+			vector<rh::ViterbiResult> scoreForward(vector<int> &observation);
+			vector<rh::ViterbiResult> scoreForward(vector<int> &observation, const vector<bool> &candidates);
+			vector<rh::ViterbiResult> scoreBeam(vector<int> &observation, const vector<bool> &candidates, int nBest, rh::Beam &beam);//LOGZERO for the models given up too
+			vector<rh::ViterbiResult> scoreBound(vector<int> &observation, const vector<bool> &candidates, int nBest, rh::Beam &beam);//LOGZERO for the models left out
+			double bound(int m, const vector<int> &observation);
+			void remainingBound(int m, const vector<rh::Run> &runs, vector<double> &remaining);//remaining[r] at least what runs r on can add, as RunViterbi wants it
+
+			static int strokes(const vector<int> &observation);
+			static int strokeTolerance();//from RH_STROKE_TOLERANCE, picked once
+			static string search();//exhaustive or bound, from RH_SEARCH, picked once
+		private:
+			vector<rh::ViterbiResult> scoreReduced(vector<int> &observation, const string &precision, const vector<bool> &candidates);
+			int packedModels;
+
+			static int chooseStrokeTolerance();
+			static const int chosenStrokeTolerance;//set before main, decoder threads only read it
+			static long nextRevision();
+			static string chooseSearch();
+			static const string chosenSearch;//set before main like ViterbiKernel's isa
+			static bool higherBound(const pair<double, int> &a, const pair<double, int> &b);
+	};
+
+	ModelBank::ModelBank(){
+		stateNum=0;
+		bandWidth=0;
+		packedModels=0;
+		revision=ModelBank::nextRevision();
+	}
+
+	void ModelBank::add(string character, string distributionProbabilityFilePath, string transitionProbabilityFilePath){
+		rh::Model model;
+		model.load(distributionProbabilityFilePath, transitionProbabilityFilePath);
+		ModelBank::add(character, model);
+	}
+
+	void ModelBank::add(string character, const rh::Model &model){
+		models.push_back(model);
+		characters.push_back(character);
+		revision = ModelBank::nextRevision();
+	}
+
+	long ModelBank::nextRevision(){
+		static long revisions = 0;
+		return ++revisions;
+	}
+
+	void ModelBank::pack(){
+		strokeIndex.clear();
+		for(int m=0; m<models.size(); m++){
+			strokeIndex[models[m].strokeNum].push_back(m);
+		}
+		groupStrokeNum.clear();
+		groupStart.clear();
+		offset.assign(models.size(), 0);
+		vector<int> group(models.size());
+		stateNum=0;
+		for(map< int, vector<int> >::iterator itr=strokeIndex.begin(); itr!=strokeIndex.end(); ++itr){
+			groupStrokeNum.push_back(itr->first);
+			groupStart.push_back(stateNum);
+			for(int i=0; i<itr->second.size(); i++){
+				int m = itr->second[i];
+				group[m] = groupStrokeNum.size()-1;
+				offset[m] = stateNum;
+				stateNum += ((models[m].stateNum+LANES-1)/LANES)*LANES;
+			}
+		}
+		groupStart.push_back(stateNum);
+
+		bandWidth=0;
+		for(int m=0; m<models.size(); m++){
+			//a model with a stroke shape only needs its stroke band, the rest is the first state's row
+			int width = models[m].strokeStateNum>0 ? models[m].strokeJumpNo : models[m].bandWidth;
+			if(models[m].leftToRight && width>bandWidth){
+				bandWidth = width;
+			}
+		}
+
+		//padding states and models the kernel can't handle keep LOGZERO transitions
+		bandTran.assign((bandWidth+1)*stateNum, rh::LOGZERO);
+		fromFirst.assign(stateNum, rh::LOGZERO);
+		symbolDis.assign(16*stateNum, rh::LOGZERO);
+		for(int m=0; m<models.size(); m++){
+			rh::Model &model = models[m];
+			int start = groupStart[group[m]];
+			int groupStates = groupStart[group[m]+1]-start;
+			double *groupTran = &bandTran[(bandWidth+1)*start];
+			for(int j=0; j<model.stateNum; j++){
+				for(int k=0; k<16; k++){
+					symbolDis[k*stateNum+offset[m]+j] = model.distribution(j, k);
+				}
+				if(model.leftToRight){
+					for(int d=0; d<=model.bandWidth && d<=bandWidth; d++){
+						groupTran[d*groupStates+offset[m]-start+j] = model.bandTran[d*model.stateNum+j];
+					}
+					if(j>bandWidth){
+						fromFirst[offset[m]+j] = model.transition(0, j);
+					}
+				}
+			}
+		}
+		//the bounds: the best way into every state, and the best state to be in for every symbol
+		intoBound.assign(stateNum, rh::LOGZERO);
+		stepBound.assign(models.size()*16, rh::LOGZERO);
+		for(int m=0; m<models.size(); m++){
+			rh::Model &model = models[m];
+			for(int j=0; j<model.stateNum; j++){
+				for(int k=model.bandStart[j]; k<=model.bandEnd[j]; k++){
+					if(model.transition(k, j)>intoBound[offset[m]+j]){
+						intoBound[offset[m]+j] = model.transition(k, j);
+					}
+				}
+				for(int k=0; k<16; k++){
+					double step = intoBound[offset[m]+j]+model.distribution(j, k);
+					if(step>stepBound[m*16+k]){
+						stepBound[m*16+k] = step;
+					}
+				}
+			}
+		}
+		prefilter.set(models);
+		reducedModels.resize(models.size());
+		forwardModels.resize(models.size());
+		for(int m=0; m<models.size(); m++){
+			reducedModels[m].set(models[m]);
+			forwardModels[m].set(models[m]);
+		}
+		packedModels = models.size();
+	}
+
+	vector<rh::ViterbiResult> ModelBank::scoreReduced(vector<int> &observation, const string &precision, const vector<bool> &candidates){
+		vector<rh::ViterbiResult> results(models.size());
+		for(int m=0; m<models.size(); m++){
+			results[m].character = characters[m];
+			if(!candidates[m]){
+				results[m].probability = rh::LOGZERO;
+			}else if(precision.compare("float")==0){
+				results[m].probability = rh::ReducedViterbi::Calculate_probability_float(reducedModels[m], observation);
+			}else{
+				results[m].probability = rh::ReducedViterbi::Calculate_probability_fixed(reducedModels[m], observation);
+			}
+		}
+		return results;
+	}
+
+	vector<rh::ViterbiResult> ModelBank::scoreForward(vector<int> &observation){
+		return ModelBank::scoreForward(observation, vector<bool>(models.size(), true));
+	}
+
+	vector<rh::ViterbiResult> ModelBank::scoreForward(vector<int> &observation, const vector<bool> &candidates){
+		if(packedModels!=models.size()){
+			ModelBank::pack();
+		}
+		vector<rh::ViterbiResult> results(models.size());
+		for(int m=0; m<models.size(); m++){
+			results[m].character = characters[m];
+			results[m].probability = candidates[m] ? rh::Forward::Calculate_probability(forwardModels[m], observation) : rh::LOGZERO;
+		}
+		return results;
+	}
+
+	vector<rh::ViterbiResult> ModelBank::scoreBeam(vector<int> &observation, const vector<bool> &candidates, int nBest, rh::Beam &beam){
+		vector<rh::ViterbiResult> results(models.size());
+		rh::Ranking ranking(nBest, false);//only for the threshold, the caller ranks the results
+		for(int m=0; m<models.size(); m++){
+			results[m].character = characters[m];
+			results[m].probability = rh::LOGZERO;
+			if(candidates[m]){
+				results[m].probability = rh::BeamViterbi::Calculate_probability(models[m], observation, ranking.threshold(), beam);
+				ranking.add(results[m]);
+			}
+		}
+		return results;
+	}
+
+	double ModelBank::bound(int m, const vector<int> &observation){
+		if(packedModels!=models.size()){
+			ModelBank::pack();
+		}
+		rh::Model &model = models[m];
+		if(model.stateNum==0 || observation.size()==0){
+			return rh::LOGZERO;
+		}
+		double bound = model.emission(observation[0])[0];
+		int currentStrokeNum = 1;
+		for(int i=1; i<observation.size() && bound!=rh::LOGZERO; i++){
+			int symbol = observation[i];
+			if(symbol>15||symbol<0){//only the forced state
+				int forcedState;
+				if(symbol>15){
+					currentStrokeNum++;
+					forcedState = (currentStrokeNum-1)*rh::STATENO;
+				}else{
+					forcedState = currentStrokeNum*rh::STATENO-1;
+				}
+				if(forcedState>=model.stateNum){
+					return rh::LOGZERO;
+				}
+				bound += intoBound[offset[m]+forcedState]+model.emission(symbol)[forcedState];
+			}else{
+				bound += stepBound[m*16+symbol];
+			}
+		}
+		if(bound==rh::LOGZERO){
+			return bound;
+		}
+		//the decoders add the same terms in another order, leave room for the rounding
+		return bound+4*observation.size()*numeric_limits<double>::epsilon()*fabs(bound);
+	}
+
+	//the same terms as bound() from the end of the observation back, a run of count frames at once
+	void ModelBank::remainingBound(int m, const vector<rh::Run> &runs, vector<double> &remaining){
+		if(packedModels!=models.size()){
+			ModelBank::pack();
+		}
+		rh::Model &model = models[m];
+		remaining.assign(runs.size()+1, 0);
+		int currentStrokeNum = 1;
+		for(int r=0; r<runs.size(); r++){
+			int symbol = runs[r].symbol;
+			if(r>0 && (symbol>15||symbol<0)){
+				int forcedState;
+				if(symbol>15){
+					currentStrokeNum++;
+					forcedState = (currentStrokeNum-1)*rh::STATENO;
+				}else{
+					forcedState = currentStrokeNum*rh::STATENO-1;
+				}
+				remaining[r] = forcedState>=model.stateNum ? rh::LOGZERO : intoBound[offset[m]+forcedState]+model.emission(symbol)[forcedState];
+			}else{
+				int count = r==0 ? runs[r].count-1 : runs[r].count;//the first frame is the first emission
+				if(count>0){
+					remaining[r] = count*stepBound[m*16+symbol];
+				}
+			}
+		}
+		for(int r=runs.size()-1; r>=0; r--){
+			remaining[r] += remaining[r+1];
+		}
+	}
+
+	//the model with the highest bound first, the first of the bank on a tie
+	bool ModelBank::higherBound(const pair<double, int> &a, const pair<double, int> &b){
+		return a.first>b.first || (a.first==b.first && a.second<b.second);
+	}
+
+	vector<rh::ViterbiResult> ModelBank::scoreBound(vector<int> &observation, const vector<bool> &candidates, int nBest, rh::Beam &beam){
+		vector<rh::ViterbiResult> results(models.size());
+		vector< pair<double, int> > order;
+		for(int m=0; m<models.size(); m++){
+			results[m].character = characters[m];
+			results[m].probability = rh::LOGZERO;
+			if(candidates[m]){
+				order.push_back(pair<double, int>(ModelBank::bound(m, observation), m));
+			}
+		}
+		sort(order.begin(), order.end(), ModelBank::higherBound);
+
+		//decoding in bank order, a tie goes to the model decoded first; here it has to go to the
+		//model first in the bank, so a model is only given up if it falls below the nBest-th best.
+		//a beam inside the trellis could lose a best path, so the width of beam isn't used, only its counters
+		rh::Beam exact(0);
+		rh::Ranking ranking(nBest, false);
+		vector<rh::Run> runs = rh::RunLength::encode(observation);
+		vector<double> remaining;
+		vector<double> strokeScores;
+		for(int i=0; i<order.size(); i++){
+			if(ranking.full() && ranking.threshold()>order[i].first){
+				break;//none of the rest can get in
+			}
+			int m = order[i].second;
+			double threshold = ranking.full() ? RH_NEXTAFTER(ranking.threshold(), rh::LOGZERO) : rh::LOGZERO;
+			ModelBank::remainingBound(m, runs, remaining);
+			results[m].probability = rh::RunViterbi::Calculate_probability(models[m], runs, remaining, threshold, strokeScores, exact);
+			ranking.add(results[m], m);
+		}
+		beam.decodes += exact.decodes;
+		beam.cells += exact.cells;
+		beam.skipped += exact.skipped;
+		beam.givenUp += exact.givenUp;
+		return results;
+	}
+
+	//the models for as many strokes as the observation has, give or take tolerance, and the models without whole strokes
+	vector<bool> ModelBank::candidates(const vector<int> &observation, int tolerance){
+		if(packedModels!=models.size()){
+			ModelBank::pack();
+		}
+		vector<bool> wanted(models.size(), tolerance<0);
+		if(tolerance<0){
+			return wanted;
+		}
+		int strokeNum = ModelBank::strokes(observation);
+		for(map< int, vector<int> >::iterator itr=strokeIndex.begin(); itr!=strokeIndex.end(); ++itr){
+			if(itr->first==0 || abs(itr->first-strokeNum)<=tolerance){
+				for(int i=0; i<itr->second.size(); i++){
+					wanted[itr->second[i]] = true;
+				}
+			}
+		}
+		return wanted;
+	}
+
+	//the first symbol starts the first stroke, every other start of stroke marker another one
+	int ModelBank::strokes(const vector<int> &observation){
+		int strokeNum = observation.size()>0 ? 1 : 0;
+		for(int i=1; i<observation.size(); i++){
+			if(observation[i]>15){
+				strokeNum++;
+			}
+		}
+		return strokeNum;
+	}
+
+	int ModelBank::strokeTolerance(){
+		return chosenStrokeTolerance;
+	}
+
+	int ModelBank::chooseStrokeTolerance(){
+		const char *wanted = getenv("RH_STROKE_TOLERANCE");
+		if(wanted!=NULL){
+			string tolerance = wanted;
+			if(tolerance.compare("all")==0){
+				return -1;
+			}
+			if(tolerance.compare("1")==0){
+				return 1;
+			}
+		}
+		return 0;
+	}
+
+	string ModelBank::search(){
+		return chosenSearch;
+	}
+
+	string ModelBank::chooseSearch(){
+		const char *wanted = getenv("RH_SEARCH");
+		if(wanted!=NULL){
+			string search = wanted;
+			if(search.compare("bound")==0){
+				return search;
+			}
+		}
+		return "exhaustive";
+	}
+
+	vector<rh::ViterbiResult> ModelBank::score(vector<int> &observation){
+		return ModelBank::score(observation, vector<bool>(models.size(), true));
+	}
+
+	vector<rh::ViterbiResult> ModelBank::score(vector<int> &observation, const vector<bool> &candidates){
+		if(packedModels!=models.size()){
+			ModelBank::pack();
+		}
+		string precision = rh::ReducedViterbi::precision();
+		if(precision.compare("double")!=0){
+			return ModelBank::scoreReduced(observation, precision, candidates);
+		}
+		vector<rh::ViterbiResult> results(models.size());
+		if(stateNum==0){
+			return results;
+		}
+
+		int firstSymbol = observation.at(0);
+		rh::Arena &arena = rh::Arena::local();
+		size_t arenaMark = arena.mark();
+		double *previous = arena.allocate<double>(stateNum);
+		double *next = arena.allocate<double>(stateNum);
+		std::fill(previous, previous+stateNum, rh::LOGZERO);
+		rh::ScoreKernel kernel = rh::ViterbiKernel::scoreKernel();
+
+		//the groups with a model to decode
+		vector<bool> groupWanted(groupStrokeNum.size(), false);
+		for(int g=0; g<groupStrokeNum.size(); g++){
+			vector<int> &groupModels = strokeIndex[groupStrokeNum[g]];
+			for(int i=0; i<groupModels.size(); i++){
+				if(candidates[groupModels[i]]){
+					groupWanted[g] = true;
+				}
+			}
+		}
+
+		//initialization: every model starts in its first state
+		for(int m=0; m<models.size(); m++){
+			if(candidates[m] && models[m].stateNum>0){
+				previous[offset[m]] = models[m].emission(firstSymbol)[0];
+			}
+		}
+
+		int currentStrokeNum = 1;
+		for(int i=1; i<observation.size(); i++){
+			int symbol = observation.at(i);
+			//the emissions of every state of the bank for this symbol, in a row for one kernel run
+			const double *distribution = &symbolDis[rh::Model::direction(symbol)*stateNum];
+			if(symbol>15||symbol<0){//start or end of a stroke: only one state of each model is allowed
+				int forcedState;
+				if(symbol>15){
+					currentStrokeNum++;
+					forcedState = (currentStrokeNum-1)*rh::STATENO;
+				}else{
+					forcedState = currentStrokeNum*rh::STATENO-1;
+				}
+				std::fill(next, next+stateNum, rh::LOGZERO);
+				for(int m=0; m<models.size(); m++){
+					if(candidates[m] && forcedState<models[m].stateNum){
+						rh::Viterbi::calculateNode(previous+offset[m], models[m], forcedState, distribution[offset[m]+forcedState], next+offset[m], NULL);
+					}
+				}
+			}else{
+				for(int g=0; g<groupStrokeNum.size(); g++){
+					int start = groupStart[g];
+					if(groupWanted[g] && groupStart[g+1]>start){
+						kernel(previous+start, &bandTran[(bandWidth+1)*start], NULL, groupStart[g+1]-start, bandWidth, distribution+start, next+start);//the first state's row comes after
+					}
+				}
+				for(int m=0; m<models.size(); m++){
+					if(!candidates[m]){
+						continue;
+					}
+					if(models[m].strokeStateNum>0){//the states the first state reaches past the band
+						double first = previous[offset[m]];
+						for(int j=offset[m]+bandWidth+1; j<offset[m]+models[m].stateNum; j++){
+							double temp = first+fromFirst[j]+distribution[j];
+							if(temp>next[j]){
+								next[j] = temp;
+							}
+						}
+					}else if(!models[m].leftToRight){
+						for(int j=0; j<models[m].stateNum; j++){
+							rh::Viterbi::calculateNode(previous+offset[m], models[m], j, distribution[offset[m]+j], next+offset[m], NULL);
+						}
+					}
+				}
+			}
+			std::swap(previous, next);
+		}
+
+		//it should always be ending at the last state.
+		for(int m=0; m<models.size(); m++){
+			results[m].character = characters[m];
+			results[m].probability = candidates[m] && models[m].stateNum>0 ? previous[offset[m]+models[m].stateNum-1] : rh::LOGZERO;
+		}
+		arena.release(arenaMark);
+		return results;
+	}
+
+	const int ModelBank::chosenStrokeTolerance = ModelBank::chooseStrokeTolerance();
+
+	const string ModelBank::chosenSearch = ModelBank::chooseSearch();
+}
+
+#endif //__ModelBank__
@@ -1,4 +1,8 @@
+#ifndef __NODE__
+#define __NODE__
+
 #include <iostream>
+#include "Constants.h"
 
 using namespace std;
 
@@ -13,8 +17,10 @@ namespace redhat{
 	};
 	
 	Node::Node(){
-		probability=log(0.0);
+		probability=LOGZERO;
 		path=-1;
 		currentPath=-1;	
 	}
-}
\ No newline at end of file
+}
+
+#endif //__NODE__
\ No newline at end of file
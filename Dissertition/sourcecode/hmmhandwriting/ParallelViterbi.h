@@ -0,0 +1,221 @@
+#ifndef __ParallelViterbi__
+#define __ParallelViterbi__
+
+#include <iostream>
+#include <stdlib.h>
+#include <algorithm>
+#include <new>
+#include <string>
+#include <vector>
+#include "Constants.h"
+#include "Model.h"
+#include "Arena.h"
+#include "Backpointers.h"
+#include "DecoderWorkspace.h"
+#include "ViterbiKernel.h"
+#include "StrokeViterbi.h"
+#include "Viterbi.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace rh = redhat;
+using namespace std;
+
+namespace redhat{
+	/* Full decoding of one long observation (a whole page of ink) on every core. Observations
+	 * shorter than MINIMUM_CHUNK columns a thread go to Viterbi::decode, and so does everything
+	 * when built without OpenMP (/openmp for cl, -fopenmp for gcc).
+	 *
+	 * Every column of the trellis is a max-plus matrix product, so the scores at the end are the
+	 * initial column times the product of the column matrices, and the product can be taken over
+	 * chunks of the observation in parallel and then combined in order, a scan. Taken as it is, the
+	 * product of a chunk costs stateNum times the work of the chunk. But a chunk that starts on a
+	 * start of stroke starts with a column where only the forced state can be reached: its matrix
+	 * has rank 1, and so has the product of the whole chunk. The chunk then only needs its last
+	 * column worked out from a made-up score of the forced state; the real score of the forced
+	 * state, from the chunk before, shifts every later score of the chunk by the same amount and
+	 * leaves its previous states alone. So:
+	 *  - the chunks are cut at starts of strokes and decoded at the same time, each keeping its
+	 *    own backpointers (the first chunk from the real first column),
+	 *  - the scan goes through the chunks in order, works out the real score of each forced state
+	 *    from the last column of the chunk before, and shifts the last column of the chunk by it,
+	 *  - the backtracking goes through the backpointers of all the chunks like in Viterbi::decode.
+	 * The scores of a chunk are added up from its own start, so the probability is the same as
+	 * that of Viterbi::decode only up to rounding, and where two paths score the same up to
+	 * rounding the path may be the other one. Every chunk keeps all of its previous states, there
+	 * are no checkpoints. With RH_PARALLEL=on BatchViterbi, and so optimise, decodes the
+	 * observations long enough for more than one chunk with it; without it optimise keeps the
+	 * paths of Viterbi::decode.
+	 */
+	class ParallelViterbi{
+		public:
+			static double decode(const rh::Model &model, const vector<int> &observation, rh::DecoderWorkspace &workspace);
+			static double decode(const rh::Model &model, const vector<int> &observation, rh::DecoderWorkspace &workspace, int chunkNum);
+			static int chunks(int columns);//how many chunks decode cuts an observation into, 1 for the sequential decode
+			static int threads();
+			static bool use();//RH_PARALLEL=on, picked once
+
+			static const int MINIMUM_CHUNK = 1024;//columns a thread has to have before a parallel decode pays
+		private:
+			static bool chooseUse();
+			static const bool chosenUse;//set before main like ViterbiKernel's isa
+	};
+
+	int ParallelViterbi::threads(){
+#ifdef _OPENMP
+		return omp_get_max_threads();
+#else
+		return 1;
+#endif
+	}
+
+	bool ParallelViterbi::use(){
+		return chosenUse;
+	}
+
+	bool ParallelViterbi::chooseUse(){
+		const char *wanted = getenv("RH_PARALLEL");
+		return wanted!=NULL && string(wanted).compare("on")==0;
+	}
+
+	int ParallelViterbi::chunks(int columns){
+		int chunkNum = columns/MINIMUM_CHUNK;
+		int threadNum = ParallelViterbi::threads();
+		return chunkNum<threadNum ? (chunkNum>1 ? chunkNum : 1) : threadNum;
+	}
+
+	double ParallelViterbi::decode(const rh::Model &model, const vector<int> &observation, rh::DecoderWorkspace &workspace){
+		return ParallelViterbi::decode(model, observation, workspace, ParallelViterbi::chunks(observation.size()));
+	}
+
+	double ParallelViterbi::decode(const rh::Model &model, const vector<int> &observation, rh::DecoderWorkspace &workspace, int chunkNum){
+		int tranColumn = model.stateNum;
+		int matrixColumn = observation.size();
+		if(chunkNum<2||tranColumn==0||matrixColumn<2){
+			return rh::Viterbi::decode(model, observation, workspace);
+		}
+
+		rh::Arena &arena = workspace.arena;
+		size_t arenaMark = arena.mark();
+
+		//cut at the first start of stroke after every matrixColumn/chunkNum columns, where the forced state is in the model
+		int *start = arena.allocate<int>(chunkNum+1);//chunk c is columns start[c]..start[c+1]-1
+		int *strokeNum = arena.allocate<int>(chunkNum);//the stroke of the first column of each chunk
+		int cuts = 1;
+		start[0] = 0;
+		strokeNum[0] = 1;
+		int currentStrokeNum = 1;
+		for(int i=1; i<matrixColumn && cuts<chunkNum; i++){
+			if(observation[i]>15){
+				currentStrokeNum++;
+				if(i>=(long)cuts*matrixColumn/chunkNum && (currentStrokeNum-1)*rh::STATENO<tranColumn){
+					start[cuts] = i;
+					strokeNum[cuts] = currentStrokeNum;
+					cuts++;
+				}
+			}
+		}
+		if(cuts<2){//one stroke, nothing to cut at
+			arena.release(arenaMark);
+			return rh::Viterbi::decode(model, observation, workspace);
+		}
+		chunkNum = cuts;
+		start[chunkNum] = matrixColumn;
+
+		rh::Backpointers *backpointers = arena.allocate<rh::Backpointers>(chunkNum);
+		double *last = arena.allocate<double>(chunkNum*tranColumn);//the last column of every chunk
+		double *columns = arena.allocate<double>(chunkNum*2*tranColumn);//previous and next of every chunk
+		int *paths = arena.allocate<int>(chunkNum*tranColumn);
+		for(int c=0; c<chunkNum; c++){//the arena hands out raw bytes, so construct each one in place
+			new (backpointers+c) rh::Backpointers();
+			backpointers[c].reset(arena, tranColumn, start[c+1]-start[c], model.jumpWidth, model.leftToRight);
+		}
+		rh::ColumnKernel kernel = rh::ViterbiKernel::kernel();
+		rh::StrokeColumn strokeKernel = rh::StrokeViterbi::kernel(model);
+
+#ifdef _OPENMP
+		#pragma omp parallel for schedule(dynamic, 1)
+#endif
+		for(int c=0; c<chunkNum; c++){
+			double *previous = columns+c*2*tranColumn;
+			double *next = previous+tranColumn;
+			int *path = paths+c*tranColumn;
+			int chunkStrokeNum = strokeNum[c];
+			for(int j=0; j<tranColumn; j++){
+				previous[j] = rh::LOGZERO;
+			}
+			if(c==0){
+				previous[0] = model.emission(observation[0])[0];
+			}else{//made up: the forced state as if the stroke started the observation
+				int forcedState = (chunkStrokeNum-1)*rh::STATENO;
+				previous[forcedState] = model.emission(observation[start[c]])[forcedState];
+			}
+			for(int i=start[c]+1; i<start[c+1]; i++){
+				rh::Viterbi::calculateColumn(model, observation[i], chunkStrokeNum, previous, next, path, kernel, strokeKernel);
+				backpointers[c].setColumn(i-start[c], path);
+				std::swap(previous, next);
+			}
+			for(int j=0; j<tranColumn; j++){
+				last[c*tranColumn+j] = previous[j];
+			}
+		}
+
+		//the scan: the real score of the forced state at the start of each chunk, and the previous states of that column
+		double *previous = columns;
+		double *next = columns+tranColumn;
+		int *path = paths;
+		for(int j=0; j<tranColumn; j++){
+			previous[j] = last[j];
+		}
+		bool reached = true;
+		for(int c=1; c<chunkNum && reached; c++){
+			int forcedState = (strokeNum[c]-1)*rh::STATENO;
+			double distribution = model.emission(observation[start[c]])[forcedState];
+			for(int j=0; j<tranColumn; j++){
+				next[j] = rh::LOGZERO;
+				path[j] = -1;
+			}
+			rh::Viterbi::calculateNode(previous, model, forcedState, distribution, next, path);
+			backpointers[c].setColumn(0, path);
+			double shift = next[forcedState]-distribution;
+			reached = next[forcedState]!=rh::LOGZERO;
+			for(int j=0; j<tranColumn; j++){
+				previous[j] = last[c*tranColumn+j]+shift;
+			}
+		}
+		if(!reached){//the made-up score reached nodes the real one can't, their previous states are wrong
+			arena.release(arenaMark);
+			return rh::Viterbi::decode(model, observation, workspace);
+		}
+		double maxProbability = previous[tranColumn-1];
+
+		//backtracking as in Viterbi::decode, chunk by chunk
+		int c = chunkNum-1;
+		int lastPath = backpointers[c].get(matrixColumn-1-start[c], tranColumn-1);
+		vector<int> &mostPossiblePath = workspace.path;
+		mostPossiblePath.resize(matrixColumn);
+		mostPossiblePath[matrixColumn-1] = lastPath<0 ? -1 : tranColumn-1;
+		mostPossiblePath[matrixColumn-2] = lastPath;
+		int previousPath = lastPath;
+		for(int i=matrixColumn-2; i>0; i--){
+			while(start[c]>i){
+				c--;
+			}
+			if(previousPath>=0){
+				previousPath = backpointers[c].get(i-start[c], previousPath);
+			}
+			mostPossiblePath[i-1] = previousPath;
+		}
+
+		arena.release(arenaMark);
+
+		workspace.probability = maxProbability;
+		return maxProbability;
+	}
+
+	const bool ParallelViterbi::chosenUse = ParallelViterbi::chooseUse();
+}
+
+#endif //__ParallelViterbi__
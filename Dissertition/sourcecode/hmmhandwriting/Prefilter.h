@@ -0,0 +1,157 @@
+#ifndef __Prefilter__
+#define __Prefilter__
+
+#include <iostream>
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+#include <vector>
+#include "Constants.h"
+#include "Model.h"
+#include "ViterbiKernel.h"
+
+namespace rh = redhat;
+using namespace std;
+
+namespace redhat{
+	/* A first stage ahead of decoding: every model is summed up by the directions it writes, and an
+	 * observation by the directions it has, and only the models whose directions fit best go on
+	 * to Viterbi. The signature of a model is the log of its emission probabilities of each of the
+	 * 16 directions averaged over its states, and the score of a model is the dot product of the
+	 * signature with the direction histogram of the observation: the log-likelihood of the
+	 * observation's directions, order left out. That is 16 multiplies a model, 4 AVX2 ones, and
+	 * the vector and scalar versions add them up in the same order, so they give the same scores.
+	 * RH_PREFILTER=M has recognise decode only the M best models of the prefilter, see
+	 * comparePrefilter for what M costs in recall.
+	 */
+	class Prefilter{
+		public:
+			static const int BINS = 16;
+
+			vector<double> signature;//signature[m*BINS+direction]
+
+			void set(const vector<rh::Model> &models);
+			double score(int m, const double *histogram) const;
+			vector<bool> shortlist(const vector<int> &observation, const vector<bool> &candidates, int size) const;//the size best candidates
+
+			static void histogram(const vector<int> &observation, double *histogram);
+			static int size();//RH_PREFILTER, picked once, 0 for no prefilter
+		private:
+			static double dot(const double *a, const double *b);
+#ifdef RH_X86
+			static double avx2Dot(const double *a, const double *b);
+#endif
+			static bool useAvx2();
+			static int chooseSize();
+			static const int chosenSize;//set before main like ViterbiKernel's isa
+			static bool higherScore(const pair<double, int> &a, const pair<double, int> &b);
+	};
+
+	void Prefilter::set(const vector<rh::Model> &models){
+		signature.assign(models.size()*BINS, 0);
+		for(int m=0; m<models.size(); m++){
+			const rh::Model &model = models[m];
+			for(int k=0; k<BINS; k++){
+				double share = 0;
+				for(int j=0; j<model.stateNum; j++){
+					share += exp(model.distribution(j, k));
+				}
+				share = model.stateNum>0 ? share/model.stateNum : 0;
+				//a direction the model never writes would rule it out on one stray point
+				signature[m*BINS+k] = log(share>1e-4 ? share : 1e-4);
+			}
+		}
+	}
+
+	void Prefilter::histogram(const vector<int> &observation, double *histogram){
+		for(int k=0; k<BINS; k++){
+			histogram[k] = 0;
+		}
+		for(int i=0; i<observation.size(); i++){
+			histogram[rh::Model::direction(observation[i])]++;
+		}
+	}
+
+	//four running sums, one for every fourth direction, added up pairwise at the end
+	double Prefilter::dot(const double *a, const double *b){
+		double sum[4];
+		for(int l=0; l<4; l++){
+			sum[l] = a[l]*b[l];
+			for(int q=1; q<BINS/4; q++){
+				sum[l] = sum[l]+a[q*4+l]*b[q*4+l];
+			}
+		}
+		return (sum[0]+sum[1])+(sum[2]+sum[3]);
+	}
+
+#ifdef RH_X86
+	RH_TARGET("avx2")
+	double Prefilter::avx2Dot(const double *a, const double *b){
+		__m256d sum = _mm256_mul_pd(_mm256_loadu_pd(a), _mm256_loadu_pd(b));
+		for(int q=1; q<BINS/4; q++){
+			sum = _mm256_add_pd(sum, _mm256_mul_pd(_mm256_loadu_pd(a+q*4), _mm256_loadu_pd(b+q*4)));
+		}
+		double lanes[4];
+		_mm256_storeu_pd(lanes, sum);
+		_mm256_zeroupper();
+		return (lanes[0]+lanes[1])+(lanes[2]+lanes[3]);
+	}
+#endif
+
+	double Prefilter::score(int m, const double *histogram) const{
+#ifdef RH_X86
+		if(Prefilter::useAvx2()){
+			return Prefilter::avx2Dot(&signature[m*BINS], histogram);
+		}
+#endif
+		return Prefilter::dot(&signature[m*BINS], histogram);
+	}
+
+	//the highest score first, the first of the bank on a tie
+	bool Prefilter::higherScore(const pair<double, int> &a, const pair<double, int> &b){
+		return a.first>b.first || (a.first==b.first && a.second<b.second);
+	}
+
+	vector<bool> Prefilter::shortlist(const vector<int> &observation, const vector<bool> &candidates, int size) const{
+		double histogram[BINS];
+		Prefilter::histogram(observation, histogram);
+		vector< pair<double, int> > scores;
+		for(int m=0; m<candidates.size(); m++){
+			if(candidates[m]){
+				scores.push_back(pair<double, int>(Prefilter::score(m, histogram), m));
+			}
+		}
+		if(size<=0 || size>=scores.size()){
+			return candidates;
+		}
+		partial_sort(scores.begin(), scores.begin()+size, scores.end(), Prefilter::higherScore);
+		vector<bool> wanted(candidates.size(), false);
+		for(int i=0; i<size; i++){
+			wanted[scores[i].second] = true;
+		}
+		return wanted;
+	}
+
+	bool Prefilter::useAvx2(){
+		return ViterbiKernel::hasAvx2();
+	}
+
+	int Prefilter::size(){
+		return chosenSize;
+	}
+
+	int Prefilter::chooseSize(){
+		const char *wanted = getenv("RH_PREFILTER");
+		if(wanted!=NULL){
+			int size = atoi(wanted);
+			if(size>0){
+				return size;
+			}
+		}
+		return 0;
+	}
+
+	const int Prefilter::chosenSize = Prefilter::chooseSize();
+}
+
+#endif //__Prefilter__
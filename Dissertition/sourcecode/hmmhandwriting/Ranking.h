@@ -0,0 +1,131 @@
+#ifndef __Ranking__
+#define __Ranking__
+
+#include <iostream>
+#include <algorithm>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "Constants.h"
+#include "ViterbiResult.h"
+
+namespace rh = redhat;
+using namespace std;
+
+namespace redhat{
+	//a result and when it was added, the earlier of two equal scores ranks first
+	class RankedResult{
+		public:
+			rh::ViterbiResult result;
+			int order;
+	};
+
+	/* The best results seen so far, at most capacity of them, capacity 0 keeping them all. They
+	 * are kept in a heap with the worst of them on top, so a result that doesn't make it costs one
+	 * comparison and one that does costs log(capacity) swaps, and the paths are dropped on the
+	 * way in unless keepPaths asks for them. threshold() is the score a result has to beat to get
+	 * in once the ranking is full: a decoder's best score in a column never goes up, so a model
+	 * can be given up as soon as its column falls below it. RH_NBEST=n has recognise keep and
+	 * print the n best characters only.
+	 */
+	class Ranking{
+		public:
+			Ranking(int capacity, bool keepPaths);
+			bool add(const rh::ViterbiResult &result);//false if it isn't among the best
+			bool add(const rh::ViterbiResult &result, int order);//ties go to the lower order rather than the one added first
+			double threshold() const;
+			bool full() const;
+			int size() const;
+			vector<rh::ViterbiResult> best() const;//best first
+
+			static int nBest();//from RH_NBEST, picked once, 0 for every character
+		private:
+			int capacity;
+			bool keepPaths;
+			int added;
+			vector<rh::RankedResult> heap;
+
+			static bool better(const rh::RankedResult &a, const rh::RankedResult &b);
+			static int chooseNBest();
+			static const int chosenNBest;//set before main like ViterbiKernel's isa
+	};
+
+	Ranking::Ranking(int capacity, bool keepPaths){
+		this->capacity = capacity>0 ? capacity : 0;
+		this->keepPaths = keepPaths;
+		added = 0;
+		if(this->capacity>0){
+			heap.reserve(this->capacity);
+		}
+	}
+
+	bool Ranking::better(const rh::RankedResult &a, const rh::RankedResult &b){
+		return a.result.probability>b.result.probability || (a.result.probability==b.result.probability && a.order<b.order);
+	}
+
+	bool Ranking::add(const rh::ViterbiResult &result){
+		return Ranking::add(result, added);
+	}
+
+	bool Ranking::add(const rh::ViterbiResult &result, int order){
+		added++;
+		rh::RankedResult ranked;
+		ranked.result.probability = result.probability;
+		ranked.order = order;
+		if(Ranking::full() && !Ranking::better(ranked, heap.front())){
+			return false;
+		}
+		if(Ranking::full()){
+			pop_heap(heap.begin(), heap.end(), Ranking::better);
+			heap.pop_back();
+		}
+		ranked.result.character = result.character;
+		if(keepPaths){
+			ranked.result.path = result.path;
+		}
+		heap.push_back(ranked);
+		push_heap(heap.begin(), heap.end(), Ranking::better);
+		return true;
+	}
+
+	double Ranking::threshold() const{
+		return Ranking::full() ? heap.front().result.probability : rh::LOGZERO;
+	}
+
+	bool Ranking::full() const{
+		return capacity>0 && heap.size()==capacity;
+	}
+
+	int Ranking::size() const{
+		return heap.size();
+	}
+
+	vector<rh::ViterbiResult> Ranking::best() const{
+		vector<rh::RankedResult> sorted = heap;
+		sort(sorted.begin(), sorted.end(), Ranking::better);
+		vector<rh::ViterbiResult> results(sorted.size());
+		for(int i=0; i<sorted.size(); i++){
+			results[i] = sorted[i].result;
+		}
+		return results;
+	}
+
+	int Ranking::nBest(){
+		return chosenNBest;
+	}
+
+	int Ranking::chooseNBest(){
+		const char *wanted = getenv("RH_NBEST");
+		if(wanted!=NULL){
+			int n = atoi(wanted);
+			if(n>0){
+				return n;
+			}
+		}
+		return 0;
+	}
+
+	const int Ranking::chosenNBest = Ranking::chooseNBest();
+}
+
+#endif //__Ranking__
@@ -0,0 +1,372 @@
+#ifndef __ReducedViterbi__
+#define __ReducedViterbi__
+
+#include <iostream>
+#include <limits>
+#include <math.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "Arena.h"
+#include "Constants.h"
+#include "Model.h"
+#include "ViterbiKernel.h"
+
+namespace rh = redhat;
+using namespace std;
+
+namespace redhat{
+	/* A model with its log-probabilities kept as float and as 16 bit fixed point. The emission
+	 * probabilities are floored at 1/(80*numOfZero) when the models are optimised, so the
+	 * log-scores never need the range of a double. A fixed point score is round(log(p)*SCALE),
+	 * and FIXEDZERO, the smallest short, stands for log(0).
+	 */
+	class ReducedModel{
+		public:
+			static const int SCALE = 64;//1/64 of a nat a step
+			static const short FIXEDZERO = -32768;
+
+			int stateNum;
+			int bandWidth;
+			int jumpWidth;//as in Model, the first state's row is tried on its own
+			bool leftToRight;
+			vector<int> bandStart;
+			vector<int> bandEnd;
+			vector<float> symbolDis;//symbolDis[symbol*stateNum+state], as in Model
+			vector<float> logTran;//logTran[from*stateNum+to]
+			vector<float> bandTran;//bandTran[d*stateNum+to]
+			vector<short> fixedDis;//the same as symbolDis
+			vector<short> fixedTran;
+			vector<short> fixedBandTran;
+
+			ReducedModel();
+			void set(const rh::Model &model);
+
+			static short toFixed(double logProbability);
+	};
+
+	/* Score-only decoding with the tables of a ReducedModel: the recursion of
+	 * Viterbi::Calculate_probability in float, or in saturating 16 bit fixed point. The fixed
+	 * point columns are shifted back so their best state is 0 after every observation, and the
+	 * shift is kept in a double on the side, so a column only has to hold the 512 nats between
+	 * its best and worst states; anything further behind saturates to FIXEDZERO and drops out.
+	 * As in StrokeViterbi a state of a normal frame is worked out from the jumpWidth states before
+	 * it and the first state, not from its whole band, which in the trained models is every state
+	 * before it: O(stateNum*(jumpWidth+2)) a column instead of O(stateNum^2). With AVX2 a normal frame is worked out 8 float or 16 fixed point states at a time. Neither
+	 * reproduces the 0 sentinel of the double decoder, so scores can differ in their last bits
+	 * (float) or by the rounding of every step (fixed point), and so can the order of two models
+	 * with almost the same score. comparePrecision reports how often the best model changes.
+	 */
+	class ReducedViterbi{
+		public:
+			static double Calculate_probability_float(const rh::ReducedModel &model, const vector<int> &observation);
+			static double Calculate_probability_fixed(const rh::ReducedModel &model, const vector<int> &observation);
+
+			static string precision();//double, float or int16, from RH_PRECISION, picked once
+		private:
+			template<class T> static void calculateNode(const T *previous, const vector<T> &tran, const rh::ReducedModel &model, int j, T distribution, T *next);
+			template<class T> static void calculateColumn(const T *previous, const T *bandTran, const T *fromFirst, int stateNum, int jumpWidth, const T *distribution, T *next, int from, int to);
+#ifdef RH_X86
+			static void avx2Float(const float *previous, const float *bandTran, const float *fromFirst, int stateNum, int jumpWidth, const float *distribution, float *next);
+			static void avx2Fixed(const short *previous, const short *bandTran, const short *fromFirst, int stateNum, int jumpWidth, const short *distribution, short *next);
+#endif
+			static bool useAvx2();
+			static string choosePrecision();
+			static const string chosenPrecision;//set before main, decoder threads only read it
+
+			static float add(float a, float b);
+			static short add(short a, short b);//saturating
+			static float zero(float);
+			static short zero(short);
+	};
+
+	ReducedModel::ReducedModel(){
+		stateNum=0;
+		bandWidth=0;
+		jumpWidth=0;
+		leftToRight=true;
+	}
+
+	short ReducedModel::toFixed(double logProbability){
+		double scaled = logProbability*SCALE;
+		if(logProbability==rh::LOGZERO || scaled<=FIXEDZERO){
+			return FIXEDZERO;
+		}
+		if(scaled>=32767){
+			return 32767;
+		}
+		return (short)floor(scaled+0.5);
+	}
+
+	void ReducedModel::set(const rh::Model &model){
+		stateNum = model.stateNum;
+		bandWidth = model.bandWidth;
+		jumpWidth = model.jumpWidth;
+		leftToRight = model.leftToRight;
+		bandStart = model.bandStart;
+		bandEnd = model.bandEnd;
+		symbolDis.assign(model.symbolDis.begin(), model.symbolDis.end());
+		logTran.assign(model.logTran.begin(), model.logTran.end());
+		bandTran.assign(model.bandTran.begin(), model.bandTran.end());
+		fixedDis.resize(model.symbolDis.size());
+		for(int i=0; i<model.symbolDis.size(); i++){
+			fixedDis[i] = ReducedModel::toFixed(model.symbolDis[i]);
+		}
+		fixedTran.resize(model.logTran.size());
+		for(int i=0; i<model.logTran.size(); i++){
+			fixedTran[i] = ReducedModel::toFixed(model.logTran[i]);
+		}
+		fixedBandTran.resize(model.bandTran.size());
+		for(int i=0; i<model.bandTran.size(); i++){
+			fixedBandTran[i] = ReducedModel::toFixed(model.bandTran[i]);
+		}
+	}
+
+	float ReducedViterbi::add(float a, float b){
+		return a+b;
+	}
+
+	short ReducedViterbi::add(short a, short b){
+		int sum = a+b;
+		sum = sum<ReducedModel::FIXEDZERO ? ReducedModel::FIXEDZERO : sum;
+		return (short)(sum>32767 ? 32767 : sum);
+	}
+
+	float ReducedViterbi::zero(float){
+		return -numeric_limits<float>::infinity();
+	}
+
+	short ReducedViterbi::zero(short){
+		return ReducedModel::FIXEDZERO;
+	}
+
+	//a node the column can't do: a forced state at the end of a stroke, or a model that goes back
+	template<class T>
+	void ReducedViterbi::calculateNode(const T *previous, const vector<T> &tran, const rh::ReducedModel &model, int j, T distribution, T *next){
+		T best = ReducedViterbi::zero(T());
+		for(int k=model.bandStart[j]; k<=model.bandEnd[j]; k++){
+			T temp = ReducedViterbi::add(previous[k], tran[k*model.stateNum+j]);
+			if(temp>best){
+				best = temp;
+			}
+		}
+		next[j] = ReducedViterbi::add(best, distribution);
+	}
+
+	//states from..to-1 of a normal frame, as in StrokeViterbi: the jumps of up to jumpWidth, then the
+	//first state, whose transitions past jumpWidth are the only ones left in the band
+	template<class T>
+	void ReducedViterbi::calculateColumn(const T *previous, const T *bandTran, const T *fromFirst, int stateNum, int jumpWidth, const T *distribution, T *next, int from, int to){
+		for(int j=from; j<to; j++){
+			T best = ReducedViterbi::add(previous[j], bandTran[j]);
+			for(int d=1; d<=jumpWidth && d<=j; d++){
+				T temp = ReducedViterbi::add(previous[j-d], bandTran[d*stateNum+j]);
+				if(temp>best){
+					best = temp;
+				}
+			}
+			if(j>jumpWidth){
+				T temp = ReducedViterbi::add(previous[0], fromFirst[j]);
+				if(temp>best){
+					best = temp;
+				}
+			}
+			next[j] = ReducedViterbi::add(best, distribution[j]);
+		}
+	}
+
+#ifdef RH_X86
+	RH_TARGET("avx2")
+	void ReducedViterbi::avx2Float(const float *previous, const float *bandTran, const float *fromFirst, int stateNum, int jumpWidth, const float *distribution, float *next){
+		int from = jumpWidth<stateNum ? jumpWidth : stateNum;
+		ReducedViterbi::calculateColumn<float>(previous, bandTran, fromFirst, stateNum, jumpWidth, distribution, next, 0, from);
+		__m256 first = _mm256_set1_ps(previous[0]);
+		int j=from;
+		for(; j+8<=stateNum; j+=8){//the first state again at j==jumpWidth, where d=j was it already
+			__m256 best = _mm256_add_ps(_mm256_loadu_ps(previous+j), _mm256_loadu_ps(bandTran+j));
+			for(int d=1; d<=jumpWidth; d++){
+				best = _mm256_max_ps(best, _mm256_add_ps(_mm256_loadu_ps(previous+j-d), _mm256_loadu_ps(bandTran+d*stateNum+j)));
+			}
+			best = _mm256_max_ps(best, _mm256_add_ps(first, _mm256_loadu_ps(fromFirst+j)));
+			_mm256_storeu_ps(next+j, _mm256_add_ps(best, _mm256_loadu_ps(distribution+j)));
+		}
+		ReducedViterbi::calculateColumn<float>(previous, bandTran, fromFirst, stateNum, jumpWidth, distribution, next, j, stateNum);
+	}
+
+	RH_TARGET("avx2")
+	void ReducedViterbi::avx2Fixed(const short *previous, const short *bandTran, const short *fromFirst, int stateNum, int jumpWidth, const short *distribution, short *next){
+		int from = jumpWidth<stateNum ? jumpWidth : stateNum;
+		ReducedViterbi::calculateColumn<short>(previous, bandTran, fromFirst, stateNum, jumpWidth, distribution, next, 0, from);
+		__m256i first = _mm256_set1_epi16(previous[0]);
+		int j=from;
+		for(; j+16<=stateNum; j+=16){
+			__m256i best = _mm256_adds_epi16(_mm256_loadu_si256((const __m256i *)(previous+j)), _mm256_loadu_si256((const __m256i *)(bandTran+j)));
+			for(int d=1; d<=jumpWidth; d++){
+				__m256i temp = _mm256_adds_epi16(_mm256_loadu_si256((const __m256i *)(previous+j-d)), _mm256_loadu_si256((const __m256i *)(bandTran+d*stateNum+j)));
+				best = _mm256_max_epi16(best, temp);
+			}
+			best = _mm256_max_epi16(best, _mm256_adds_epi16(first, _mm256_loadu_si256((const __m256i *)(fromFirst+j))));
+			_mm256_storeu_si256((__m256i *)(next+j), _mm256_adds_epi16(best, _mm256_loadu_si256((const __m256i *)(distribution+j))));
+		}
+		ReducedViterbi::calculateColumn<short>(previous, bandTran, fromFirst, stateNum, jumpWidth, distribution, next, j, stateNum);
+	}
+#endif
+
+	bool ReducedViterbi::useAvx2(){
+		return ViterbiKernel::hasAvx2();
+	}
+
+	double ReducedViterbi::Calculate_probability_float(const rh::ReducedModel &model, const vector<int> &observation){
+		int tranColumn = model.stateNum;
+		int firstSymbol = rh::Model::direction(observation.at(0));
+		if(tranColumn==0){
+			return rh::LOGZERO;
+		}
+		rh::Arena &arena = rh::Arena::local();
+		size_t arenaMark = arena.mark();
+		float *previous = arena.allocate<float>(tranColumn);
+		float *next = arena.allocate<float>(tranColumn);
+		const float logZero = ReducedViterbi::zero(float());
+		bool avx2 = ReducedViterbi::useAvx2();
+
+		previous[0] = model.symbolDis[firstSymbol*tranColumn];
+		for(int j=1; j<tranColumn; j++){
+			previous[j] = logZero;
+		}
+
+		int currentStrokeNum = 1;
+		for(int i=1; i<observation.size(); i++){
+			int symbol = observation.at(i);
+			const float *distribution = &model.symbolDis[rh::Model::direction(symbol)*tranColumn];
+			if(symbol>15||symbol<0){//only the first state of a stroke at its start, and the last state at its end
+				int forcedState;
+				if(symbol>15){
+					currentStrokeNum++;
+					forcedState = (currentStrokeNum-1)*rh::STATENO;
+				}else{
+					forcedState = currentStrokeNum*rh::STATENO-1;
+				}
+				for(int j=0; j<tranColumn; j++){
+					next[j] = logZero;
+				}
+				if(forcedState<tranColumn){
+					ReducedViterbi::calculateNode<float>(previous, model.logTran, model, forcedState, distribution[forcedState], next);
+				}
+			}else if(model.leftToRight){
+#ifdef RH_X86
+				if(avx2){
+					ReducedViterbi::avx2Float(previous, &model.bandTran[0], &model.logTran[0], tranColumn, model.jumpWidth, distribution, next);
+				}else
+#endif
+				ReducedViterbi::calculateColumn<float>(previous, &model.bandTran[0], &model.logTran[0], tranColumn, model.jumpWidth, distribution, next, 0, tranColumn);
+			}else{
+				for(int j=0; j<tranColumn; j++){
+					ReducedViterbi::calculateNode<float>(previous, model.logTran, model, j, distribution[j], next);
+				}
+			}
+			float *swap = previous;
+			previous = next;
+			next = swap;
+		}
+
+		//it should always be ending at the last state.
+		double probability = previous[tranColumn-1]==logZero ? rh::LOGZERO : previous[tranColumn-1];
+		arena.release(arenaMark);
+		return probability;
+	}
+
+	double ReducedViterbi::Calculate_probability_fixed(const rh::ReducedModel &model, const vector<int> &observation){
+		int tranColumn = model.stateNum;
+		int firstSymbol = rh::Model::direction(observation.at(0));
+		if(tranColumn==0){
+			return rh::LOGZERO;
+		}
+		rh::Arena &arena = rh::Arena::local();
+		size_t arenaMark = arena.mark();
+		short *previous = arena.allocate<short>(tranColumn);
+		short *next = arena.allocate<short>(tranColumn);
+		bool avx2 = ReducedViterbi::useAvx2();
+		double shift = 0;//what has been taken off the columns so far, in fixed point
+
+		previous[0] = model.fixedDis[firstSymbol*tranColumn];
+		for(int j=1; j<tranColumn; j++){
+			previous[j] = ReducedModel::FIXEDZERO;
+		}
+
+		int currentStrokeNum = 1;
+		for(int i=1; i<observation.size(); i++){
+			//shift the column so its best state is 0, the nodes that can't be reached stay at FIXEDZERO
+			short best = ReducedModel::FIXEDZERO;
+			for(int j=0; j<tranColumn; j++){
+				if(previous[j]>best) best = previous[j];
+			}
+			if(best==ReducedModel::FIXEDZERO){
+				break;
+			}
+			for(int j=0; j<tranColumn; j++){
+				short v = previous[j]-best;
+				previous[j] = previous[j]==ReducedModel::FIXEDZERO ? ReducedModel::FIXEDZERO : v;
+			}
+			shift += best;
+
+			int symbol = observation.at(i);
+			const short *distribution = &model.fixedDis[rh::Model::direction(symbol)*tranColumn];
+			if(symbol>15||symbol<0){//only the first state of a stroke at its start, and the last state at its end
+				int forcedState;
+				if(symbol>15){
+					currentStrokeNum++;
+					forcedState = (currentStrokeNum-1)*rh::STATENO;
+				}else{
+					forcedState = currentStrokeNum*rh::STATENO-1;
+				}
+				for(int j=0; j<tranColumn; j++){
+					next[j] = ReducedModel::FIXEDZERO;
+				}
+				if(forcedState<tranColumn){
+					ReducedViterbi::calculateNode<short>(previous, model.fixedTran, model, forcedState, distribution[forcedState], next);
+				}
+			}else if(model.leftToRight){
+#ifdef RH_X86
+				if(avx2){
+					ReducedViterbi::avx2Fixed(previous, &model.fixedBandTran[0], &model.fixedTran[0], tranColumn, model.jumpWidth, distribution, next);
+				}else
+#endif
+				ReducedViterbi::calculateColumn<short>(previous, &model.fixedBandTran[0], &model.fixedTran[0], tranColumn, model.jumpWidth, distribution, next, 0, tranColumn);
+			}else{
+				for(int j=0; j<tranColumn; j++){
+					ReducedViterbi::calculateNode<short>(previous, model.fixedTran, model, j, distribution[j], next);
+				}
+			}
+			short *swap = previous;
+			previous = next;
+			next = swap;
+		}
+
+		//it should always be ending at the last state.
+		double probability = rh::LOGZERO;
+		if(previous[tranColumn-1]!=ReducedModel::FIXEDZERO){
+			probability = (shift+previous[tranColumn-1])/ReducedModel::SCALE;
+		}
+		arena.release(arenaMark);
+		return probability;
+	}
+
+	string ReducedViterbi::precision(){
+		return chosenPrecision;
+	}
+
+	string ReducedViterbi::choosePrecision(){
+		const char *wanted = getenv("RH_PRECISION");
+		if(wanted!=NULL){
+			string precision = wanted;
+			if(precision.compare("float")==0 || precision.compare("int16")==0){
+				return precision;
+			}
+		}
+		return "double";
+	}
+
+	const string ReducedViterbi::chosenPrecision = ReducedViterbi::choosePrecision();
+}
+
+#endif //__ReducedViterbi__
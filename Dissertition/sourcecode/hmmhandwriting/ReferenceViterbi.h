@@ -0,0 +1,145 @@
+#ifndef __ReferenceViterbi__
+#define __ReferenceViterbi__
+
+#include <iostream>
+#include <vector>
+#include "Constants.h"
+#include "Model.h"
+#include "ViterbiResult.h"
+
+namespace rh = redhat;
+using namespace std;
+
+namespace redhat{
+	/* The recursion of Viterbi.h as it was before any of the faster decoders, kept as the reference
+	 * they are all checked against, see compareEngines.cpp. Every node of the trellis tries every
+	 * state of the column before with the comparisons of the old loop, the 0 sentinel included,
+	 * and the whole trellis is kept, so it is slow on purpose: don't optimise it, and don't change
+	 * it along with an engine. The only things taken from the new code are the log tables of
+	 * Model and the layout of the path, which is the one of Viterbi::decode (the state of every
+	 * column but the last, then the current state of the last column, -1 after a node the stroke
+	 * markers ruled out). An empty observation throws std::out_of_range like Viterbi.h does.
+	 */
+	class ReferenceViterbi{
+		public:
+			static rh::ViterbiResult decode(const rh::Model &model, const vector<int> &observation);
+			static double pathScore(const rh::Model &model, const vector<int> &observation, const vector<int> &path);
+	};
+
+	rh::ViterbiResult ReferenceViterbi::decode(const rh::Model &model, const vector<int> &observation){
+		rh::ViterbiResult result;
+		int tranColumn = model.stateNum;
+		int matrixColumn = observation.size();
+		int firstSymbol = rh::Model::direction(observation.at(0));
+		result.probability = rh::LOGZERO;
+		if(tranColumn==0){
+			return result;
+		}
+
+		vector<double> probability(matrixColumn*tranColumn, rh::LOGZERO);//probability[i*tranColumn+j]
+		vector<int> path(matrixColumn*tranColumn, 0);
+		probability[0] = model.distribution(0, firstSymbol);
+
+		int currentStrokeNum = 1;
+		for(int i=1; i<matrixColumn; i++){//calculate column by column
+			int symbol = observation.at(i);
+			int forcedState = -1;//the only state a start or end of stroke leaves
+			int ruledOut = 0;
+			if(symbol>15){//the staring state = vector number+16
+				currentStrokeNum++;
+				forcedState = (currentStrokeNum-1)*rh::STATENO;
+				ruledOut = -1;
+			}else if(symbol<0){//the ending state = vector number -16
+				forcedState = currentStrokeNum*rh::STATENO-1;
+				ruledOut = -2;
+			}
+			for(int j=0; j<tranColumn; j++){//calculate each node
+				if(forcedState>=0 && j!=forcedState){
+					probability[i*tranColumn+j] = rh::LOGZERO;
+					path[i*tranColumn+j] = ruledOut;
+					continue;
+				}
+				double distribution = model.distribution(j, rh::Model::direction(symbol));
+				double maxProbAtPresent = 0;
+				double maxPathProbAtPresent = 0;
+				int maxPath = 0;//default is from the state one.
+				for(int k=0; k<tranColumn; k++){//calculate every previous node
+					double tempPathProb = probability[(i-1)*tranColumn+k]+model.transition(k, j);
+					double tempProb = tempPathProb+distribution;
+					if (maxProbAtPresent == 0){
+						maxProbAtPresent=tempProb;
+					}
+					if (maxPathProbAtPresent == 0){
+						maxPathProbAtPresent=tempPathProb;
+					}
+					if (tempProb>=maxProbAtPresent){
+						maxProbAtPresent=tempProb;
+					}
+					if (tempPathProb >= maxPathProbAtPresent){
+						maxPathProbAtPresent = tempPathProb;
+						maxPath = k;
+					}
+				}
+				probability[i*tranColumn+j] = maxProbAtPresent;
+				path[i*tranColumn+j] = maxPath;
+			}
+		}
+
+		//it should always be ending at the last state.
+		result.probability = probability[(matrixColumn-1)*tranColumn+tranColumn-1];
+
+		//state path backtracking
+		if(matrixColumn==1){
+			result.path.push_back(0);
+			result.path.push_back(tranColumn>1 ? -1 : tranColumn-1);
+			return result;
+		}
+		result.path.resize(matrixColumn);
+		int lastPath = path[(matrixColumn-1)*tranColumn+tranColumn-1];
+		result.path[matrixColumn-1] = lastPath<0 ? -1 : tranColumn-1;
+		result.path[matrixColumn-2] = lastPath;
+		int previousPath = lastPath;
+		for(int i=matrixColumn-2; i>0; i--){
+			if(previousPath>=0){
+				previousPath = path[i*tranColumn+previousPath];
+			}
+			result.path[i-1] = previousPath;
+		}
+		return result;
+	}
+
+	/* The score of one path through the trellis, in the layout decode gives it, or LOGZERO if it
+	 * isn't a path the model and the stroke markers allow. Two decoders can give different paths
+	 * with the same score; this tells such a tie from a wrong path.
+	 */
+	double ReferenceViterbi::pathScore(const rh::Model &model, const vector<int> &observation, const vector<int> &path){
+		int tranColumn = model.stateNum;
+		int matrixColumn = observation.size();
+		if(tranColumn==0 || matrixColumn==0 || path.size()!=(matrixColumn>1 ? matrixColumn : 2)){
+			return rh::LOGZERO;
+		}
+		if(path[0]!=0 || path[path.size()-1]!=tranColumn-1){
+			return rh::LOGZERO;
+		}
+		double score = model.distribution(0, rh::Model::direction(observation[0]));
+		int currentStrokeNum = 1;
+		for(int i=1; i<matrixColumn; i++){
+			int symbol = observation[i];
+			int state = path[i];
+			int forcedState = -1;
+			if(symbol>15){
+				currentStrokeNum++;
+				forcedState = (currentStrokeNum-1)*rh::STATENO;
+			}else if(symbol<0){
+				forcedState = currentStrokeNum*rh::STATENO-1;
+			}
+			if(state<0 || state>=tranColumn || (forcedState>=0 && state!=forcedState)){
+				return rh::LOGZERO;
+			}
+			score = score+model.transition(path[i-1], state)+model.distribution(state, rh::Model::direction(symbol));
+		}
+		return score;
+	}
+}
+
+#endif //__ReferenceViterbi__
@@ -0,0 +1,52 @@
+#ifndef __RunLength__
+#define __RunLength__
+
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+namespace redhat{
+	/* An observation stream with every run of the same direction code kept once, with its length.
+	 * A straight piece of a stroke gives the same code many times over. The start and end of
+	 * stroke codes (>15 and <0) are always a run of their own, so the decoder still sees them.
+	 */
+	class Run{
+		public:
+			int symbol;//the observation code as written by quantilise
+			int count;//how many times in a row
+	};
+
+	class RunLength{
+		public:
+			static vector<rh::Run> encode(const vector<int> &observation);
+			static vector<int> decode(const vector<rh::Run> &runs);
+	};
+
+	vector<rh::Run> RunLength::encode(const vector<int> &observation){
+		vector<rh::Run> runs;
+		for(int i=0; i<observation.size(); i++){
+			int symbol = observation[i];
+			bool marker = symbol>15||symbol<0;
+			if(!marker && runs.size()>0 && runs.back().symbol==symbol){
+				runs.back().count++;
+			}else{
+				rh::Run run;
+				run.symbol = symbol;
+				run.count = 1;
+				runs.push_back(run);
+			}
+		}
+		return runs;
+	}
+
+	vector<int> RunLength::decode(const vector<rh::Run> &runs){
+		vector<int> observation;
+		for(int i=0; i<runs.size(); i++){
+			observation.insert(observation.end(), runs[i].count, runs[i].symbol);
+		}
+		return observation;
+	}
+}
+
+#endif //__RunLength__
@@ -0,0 +1,210 @@
+#ifndef __RunViterbi__
+#define __RunViterbi__
+
+#include <iostream>
+#include <limits>
+#include <math.h>
+#include <vector>
+#include "BeamViterbi.h"
+#include "Constants.h"
+#include "Model.h"
+#include "Arena.h"
+#include "RunLength.h"
+#include "Viterbi.h"
+
+namespace rh = redhat;
+using namespace std;
+
+namespace redhat{
+	/* Score-only decoding of a run-length encoded observation, see RunLength. While the symbol
+	 * stays the same every column is the same max-plus matrix A, and a run of count columns is
+	 * A^count. Working A^count out beforehand would add the transitions of the run up before the
+	 * score of the previous column instead of after, which rounds differently, so the scores would
+	 * only match up to rounding. Instead a run is taken in one call with its emission row fixed,
+	 * and its columns are applied one after the other, each after the column before; what the
+	 * closed form of A^count gives is which states can be live at all:
+	 *  - none before the state the last stroke marker forced,
+	 *  - every state of a left-to-right model only while the first state is live, otherwise jumpWidth
+	 *    more states each column,
+	 *  - none past the state the next marker forces, as nothing after it can reach that state.
+	 * Only that window of states is worked out, and the states outside it are LOGZERO just as in
+	 * Viterbi::Calculate_probability, so the score is bitwise the same.
+	 *
+	 * Inside a stroke the window is the stroke's own states, and at a marker it is the forced state
+	 * alone, so its score is the score of the whole observation so far. strokeScores gets that score
+	 * at the first point of every stroke, and ModelBank::scoreBound gives a model up at a marker once
+	 * it plus remaining, the most the rest of the observation can add, is no better than threshold,
+	 * like BeamViterbi does with the best of a column. Models that can go back are decoded column by
+	 * column, without stroke scores and never given up.
+	 */
+	class RunViterbi{
+		public:
+			static double Calculate_probability(const rh::Model &model, const vector<rh::Run> &runs);
+			static double Calculate_probability(const rh::Model &model, const vector<rh::Run> &runs, const vector<double> &remaining, double threshold, vector<double> &strokeScores, rh::Beam &beam);//remaining empty to never give up
+		private:
+			static long calculateRun(const rh::Model &model, const double *distribution, int count, int low, int &high, int bound, double *&previous, double *&next);
+	};
+
+	double RunViterbi::Calculate_probability(const rh::Model &model, const vector<rh::Run> &runs){
+		vector<double> strokeScores;
+		rh::Beam beam(0);
+		return RunViterbi::Calculate_probability(model, runs, vector<double>(), rh::LOGZERO, strokeScores, beam);
+	}
+
+	//remaining[r] is the most runs r on can add, and remaining[runs.size()] is 0
+	double RunViterbi::Calculate_probability(const rh::Model &model, const vector<rh::Run> &runs, const vector<double> &remaining, double threshold, vector<double> &strokeScores, rh::Beam &beam){
+		int tranColumn = model.stateNum;
+		strokeScores.clear();
+		if(tranColumn==0||runs.size()==0){
+			return rh::LOGZERO;
+		}
+		beam.decodes++;
+		int columns = 0;
+		for(int r=0; r<runs.size(); r++){
+			columns += runs[r].count;
+		}
+		if(!model.leftToRight){//no window to keep to
+			beam.cells += (long)columns*tranColumn;
+			return rh::Viterbi::Calculate_probability(model, rh::RunLength::decode(runs));
+		}
+		rh::Arena &arena = rh::Arena::local();
+		size_t arenaMark = arena.mark();
+		double *previous = arena.allocate<double>(tranColumn);
+		double *next = arena.allocate<double>(tranColumn);
+		int *nextMarker = arena.allocate<int>(runs.size());//the next run that is a stroke marker, -1 after the last
+		int marker = -1;
+		for(int r=runs.size()-1; r>=0; r--){
+			nextMarker[r] = marker;
+			if(runs[r].symbol>15||runs[r].symbol<0){
+				marker = r;
+			}
+		}
+
+		for(int j=0; j<tranColumn; j++){
+			previous[j] = rh::LOGZERO;
+			next[j] = rh::LOGZERO;
+		}
+		previous[0] = model.emission(runs[0].symbol)[0];
+		strokeScores.push_back(previous[0]);
+		beam.cells++;
+		beam.skipped += tranColumn-1;
+
+		int currentStrokeNum = 1;
+		int low = 0;//the first state that can be live
+		int high = 0;//the last state that is live
+		double probability = rh::LOGZERO;
+		bool stopped = false;
+		int column = 1;//the columns worked out
+		for(int r=0; r<runs.size() && !stopped; r++){
+			int symbol = runs[r].symbol;
+			const double *distribution = model.emission(symbol);
+			if(r==0){//the first observation started the trellis
+				if(runs[r].count==1){
+					continue;
+				}
+			}else if(symbol>15||symbol<0){//only the first state of a stroke at its start, and the last state at its end
+				int forcedState;
+				if(symbol>15){
+					currentStrokeNum++;
+					forcedState = (currentStrokeNum-1)*rh::STATENO;
+				}else{
+					forcedState = currentStrokeNum*rh::STATENO-1;
+				}
+				for(int j=low; j<=high; j++){
+					next[j] = rh::LOGZERO;
+				}
+				if(forcedState<tranColumn){
+					rh::Viterbi::calculateNode(previous, model, forcedState, distribution[forcedState], next, NULL);
+				}
+				for(int j=low; j<=high; j++){//both columns are LOGZERO again but for the forced state
+					previous[j] = rh::LOGZERO;
+				}
+				double *swap = previous;
+				previous = next;
+				next = swap;
+				stopped = forcedState>=tranColumn || previous[forcedState]==rh::LOGZERO;
+				column++;
+				beam.cells++;
+				beam.skipped += tranColumn-1;
+				if(!stopped && symbol>15){
+					strokeScores.push_back(previous[forcedState]);
+				}
+				if(!stopped && remaining.size()>0){
+					//the decode adds the same terms in another order than remaining, leave room for the rounding
+					double score = previous[forcedState];
+					double rest = remaining[r+1];
+					double slack = 4*columns*numeric_limits<double>::epsilon()*(fabs(score)+fabs(rest));
+					stopped = rest==rh::LOGZERO || !(score+rest+slack>threshold);
+				}
+				if(stopped){
+					beam.givenUp++;
+					beam.skipped += (long)(columns-column)*tranColumn;
+				}
+				low = forcedState;
+				high = forcedState;
+				continue;
+			}
+
+			//the furthest state still of use is the one the next marker forces
+			int bound = tranColumn-1;
+			int m = nextMarker[r];
+			if(m>=0){
+				int forcedState = runs[m].symbol>15 ? currentStrokeNum*rh::STATENO : currentStrokeNum*rh::STATENO-1;
+				if(forcedState<bound){
+					bound = forcedState;
+				}
+			}
+			int count = r==0 ? runs[r].count-1 : runs[r].count;
+			long cells = RunViterbi::calculateRun(model, distribution, count, low, high, bound, previous, next);
+			column += count;
+			beam.cells += cells;
+			beam.skipped += (long)count*tranColumn-cells;
+		}
+
+		if(!stopped){
+			probability = previous[tranColumn-1];
+		}
+		arena.release(arenaMark);
+		return probability;
+	}
+
+	//count columns of one symbol over the states low..bound, the same terms as ViterbiKernel::calculateState; gives the nodes worked out
+	long RunViterbi::calculateRun(const rh::Model &model, const double *distribution, int count, int low, int &high, int bound, double *&previous, double *&next){
+		int stateNum = model.stateNum;
+		int jumpWidth = model.jumpWidth;
+		const double *bandTran = &model.bandTran[0];
+		const double *fromFirst = &model.logTran[0];//the transitions out of the first state
+		long cells = 0;
+		for(int t=0; t<count; t++){
+			bool fromStart = low==0 && previous[0]!=rh::LOGZERO;
+			int reach = fromStart ? bound : high+jumpWidth;
+			if(reach>bound){
+				reach = bound;
+			}
+			for(int j=low; j<=reach; j++){
+				double best = rh::LOGZERO;
+				for(int d=0; d<=jumpWidth && j-d>=low; d++){
+					double temp = previous[j-d]+bandTran[d*stateNum+j];
+					if(temp>best){
+						best = temp;
+					}
+				}
+				if(fromStart && j>jumpWidth){
+					double temp = previous[0]+fromFirst[j];
+					if(temp>best){
+						best = temp;
+					}
+				}
+				next[j] = best+distribution[j];
+			}
+			double *swap = previous;
+			previous = next;
+			next = swap;
+			high = reach;
+			cells += reach-low+1;
+		}
+		return cells;
+	}
+}
+
+#endif //__RunViterbi__
@@ -0,0 +1,503 @@
+#ifndef __ShortlistIndex__
+#define __ShortlistIndex__
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <math.h>
+#include <queue>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/path.hpp>
+#include "Constants.h"
+#include "Model.h"
+#include "ModelBank.h"
+#include "Prefilter.h"
+
+namespace fs = boost::filesystem;
+namespace rh = redhat;
+using namespace std;
+
+namespace redhat{
+	/* The shortlist of the prefilter without scoring every model, for banks too big to scan.
+	 * The prefilter ranks by the dot product of the signature of a model with the direction
+	 * histogram of an observation. Less the dot product with the mean signature, the same for
+	 * every model, that is the cosine of the histogram and the model's embedding: its centred
+	 * signature scaled into the unit ball, with one more coordinate to make it unit length, which
+	 * the histogram has 0 of. So the best models of the prefilter are the nearest neighbours of
+	 * the histogram among the embeddings, and the index finds those with a hierarchical navigable
+	 * small world graph (HNSW), one graph for every stroke count. Every model is linked to the
+	 * LINKS nearest ones it was added next to, twice as many on the bottom layer, and a random few
+	 * are also on the layers above with links of their own; a search walks down from the top of
+	 * the graph to the models nearest the histogram and keeps the SEARCH best it meets on the
+	 * bottom layer. shortlist() does that in the graphs of the observation's stroke counts, scores
+	 * only the models it met and keeps the size best, reading a number of models that grows with
+	 * the log of the bank rather than the bank. It is approximate, compareIndex reports how often
+	 * it keeps what the scan keeps and how fast it is.
+	 *
+	 * That is the shortlist alone. recognise still loads and packs every model for each sample,
+	 * and attach goes through the whole bank once for every bank it is given, so a recognise run
+	 * as a whole still grows with the bank; the index saves the scoring, not the loading. Keeping
+	 * the bank and the attached index between samples is what it would take to save that too.
+	 *
+	 * optimise builds it at the end of training and saves it with the signatures it was built
+	 * from. A model of the bank that isn't in it, or whose signature has changed since, is always
+	 * scored. RH_INDEX=on has recognise take the RH_PREFILTER shortlist from the index.
+	 */
+	class ShortlistIndex{
+		public:
+			static const int DIMENSIONS = rh::Prefilter::BINS+1;
+			static const int LINKS = 8;//links a model keeps to the others above the bottom layer
+			static const int BUILD = 64;//models a search keeps while the graph is built
+			static const int SEARCH = 48;//models a search keeps for a shortlist, at least size
+
+			vector<double> centre;//the mean signature
+			double scale;//the longest centred signature
+			vector<string> characters;
+			vector<int> strokeNums;
+			vector<double> signature;//signature[item*BINS+direction], as they were built from
+			vector<double> points;//points[item*DIMENSIONS+coordinate], the embeddings
+			vector< vector< vector<int> > > links;//links[item][layer], the items linked to
+			map<int, int> entry;//the item at the top of the graph of each stroke count
+			long visited;//embeddings compared by shortlist, over every shortlist
+			long reranked;//models scored by shortlist, over every shortlist
+
+			ShortlistIndex();
+			void build(rh::ModelBank &bank);
+			bool save(string indexFilePath) const;
+			bool load(string indexFilePath);//false if there is no index there
+			void attach(rh::ModelBank &bank);
+			vector<bool> shortlist(rh::ModelBank &bank, const vector<int> &observation, int tolerance, int size);//the size best of the candidates with tolerance
+
+			static bool use();//RH_INDEX=on, picked once
+		private:
+			vector<int> itemModel;//the bank model of each item, -1 if it isn't in the bank as it was
+			vector<int> unindexed;//bank models always scored
+			long attachedRevision;//the revision of the bank the items were mapped to, 0 for none
+			vector<int> marks;//the search each item was last met in
+			int search;
+
+			void embed(int item);
+			void insert(int item, int level);
+			int descend(const double *query, int from, int top, int bottom);
+			vector< pair<double, int> > searchLayer(const double *query, int from, int layer, int width);
+			vector<int> select(const vector< pair<double, int> > &nearest, int count) const;
+			double similarity(const double *query, int item);
+			double similarity(int a, int b) const;
+
+			static int randomLevel(unsigned int &seed);
+			static bool chooseUse();
+			static const bool chosenUse;//set before main like ViterbiKernel's isa
+			static bool higherScore(const pair<double, int> &a, const pair<double, int> &b);
+	};
+
+	ShortlistIndex::ShortlistIndex(){
+		scale = 1;
+		visited = 0;
+		reranked = 0;
+		attachedRevision = 0;
+		search = 0;
+	}
+
+	void ShortlistIndex::build(rh::ModelBank &bank){
+		if(bank.prefilter.signature.size()!=bank.models.size()*rh::Prefilter::BINS){
+			bank.pack();
+		}
+		int items = bank.models.size();
+		characters = bank.characters;
+		strokeNums.resize(items);
+		for(int m=0; m<items; m++){
+			strokeNums[m] = bank.models[m].strokeNum;
+		}
+		signature = bank.prefilter.signature;
+		centre.assign(rh::Prefilter::BINS, 0);
+		for(int m=0; m<items; m++){
+			for(int k=0; k<rh::Prefilter::BINS; k++){
+				centre[k] += signature[m*rh::Prefilter::BINS+k]/items;
+			}
+		}
+		scale = 0;
+		for(int m=0; m<items; m++){
+			double length = 0;
+			for(int k=0; k<rh::Prefilter::BINS; k++){
+				double d = signature[m*rh::Prefilter::BINS+k]-centre[k];
+				length += d*d;
+			}
+			if(sqrt(length)>scale){
+				scale = sqrt(length);
+			}
+		}
+		if(scale==0){
+			scale = 1;
+		}
+
+		points.resize(items*DIMENSIONS);
+		links.assign(items, vector< vector<int> >());
+		entry.clear();
+		marks.assign(items, 0);
+		unsigned int seed = 2007;
+		for(int item=0; item<items; item++){
+			ShortlistIndex::embed(item);
+			ShortlistIndex::insert(item, ShortlistIndex::randomLevel(seed));
+		}
+		attachedRevision = 0;
+		ShortlistIndex::attach(bank);
+	}
+
+	//every number on a line of its own, as the model files are, with all the digits of a double
+	bool ShortlistIndex::save(string indexFilePath) const{
+		fs::ofstream indexFile(indexFilePath);
+		if(!indexFile){
+			cout<<"Cannot open file.\n";
+			return false;
+		}
+		indexFile<<setprecision(17);
+		indexFile<<characters.size()<<endl<<scale<<endl;
+		for(int k=0; k<centre.size(); k++){
+			indexFile<<centre[k]<<endl;
+		}
+		for(int item=0; item<characters.size(); item++){
+			indexFile<<characters[item]<<endl<<strokeNums[item]<<endl;
+			for(int k=0; k<rh::Prefilter::BINS; k++){
+				indexFile<<signature[item*rh::Prefilter::BINS+k]<<endl;
+			}
+			indexFile<<links[item].size()<<endl;
+			for(int layer=0; layer<links[item].size(); layer++){
+				indexFile<<links[item][layer].size()<<endl;
+				for(int i=0; i<links[item][layer].size(); i++){
+					indexFile<<links[item][layer][i]<<endl;
+				}
+			}
+		}
+		indexFile.close();
+		return true;
+	}
+
+	bool ShortlistIndex::load(string indexFilePath){
+		fs::ifstream indexFile(indexFilePath);
+		if(!indexFile){
+			return false;
+		}
+		int items = -1;
+		indexFile>>items>>scale;
+		centre.resize(rh::Prefilter::BINS);
+		for(int k=0; k<centre.size(); k++){
+			indexFile>>centre[k];
+		}
+		bool valid = indexFile && items>=0;
+		characters.assign(valid ? items : 0, string());
+		strokeNums.assign(characters.size(), 0);
+		signature.assign(characters.size()*rh::Prefilter::BINS, 0);
+		points.resize(characters.size()*DIMENSIONS);
+		links.assign(characters.size(), vector< vector<int> >());
+		entry.clear();
+		for(int item=0; valid && item<items; item++){
+			int layers = 0;
+			indexFile>>characters[item]>>strokeNums[item];
+			for(int k=0; k<rh::Prefilter::BINS; k++){
+				indexFile>>signature[item*rh::Prefilter::BINS+k];
+			}
+			indexFile>>layers;
+			valid = indexFile && layers>0;
+			for(int layer=0; valid && layer<layers; layer++){
+				int count = 0;
+				indexFile>>count;
+				links[item].push_back(vector<int>(count>0 ? count : 0));
+				for(int i=0; i<count; i++){
+					indexFile>>links[item][layer][i];
+					valid = valid && links[item][layer][i]>=0 && links[item][layer][i]<items;
+				}
+				valid = valid && indexFile;
+			}
+			if(valid){
+				ShortlistIndex::embed(item);
+				//the top is the first item on the most layers, as insert leaves it
+				map<int, int>::iterator top = entry.find(strokeNums[item]);
+				if(top==entry.end() || links[item].size()>links[top->second].size()){
+					entry[strokeNums[item]] = item;
+				}
+			}
+		}
+		if(!valid){
+			cout<<"Cannot read the index "<<indexFilePath<<endl;
+			characters.clear();
+			links.clear();
+			entry.clear();
+			return false;
+		}
+		marks.assign(items, 0);
+		attachedRevision = 0;
+		return true;
+	}
+
+	//the bank model of every item, and the bank models that have no item
+	void ShortlistIndex::attach(rh::ModelBank &bank){
+		if(bank.prefilter.signature.size()!=bank.models.size()*rh::Prefilter::BINS){
+			bank.pack();
+		}
+		map<string, int> models;
+		for(int m=0; m<bank.models.size(); m++){
+			models[bank.characters[m]] = m;
+		}
+		itemModel.assign(characters.size(), -1);
+		vector<bool> indexed(bank.models.size(), false);
+		for(int item=0; item<characters.size(); item++){
+			map<string, int>::iterator found = models.find(characters[item]);
+			if(found==models.end() || indexed[found->second] || strokeNums[item]!=bank.models[found->second].strokeNum){
+				continue;
+			}
+			bool same = true;
+			for(int k=0; k<rh::Prefilter::BINS; k++){
+				same = same && signature[item*rh::Prefilter::BINS+k]==bank.prefilter.signature[found->second*rh::Prefilter::BINS+k];
+			}
+			if(same){
+				itemModel[item] = found->second;
+				indexed[found->second] = true;
+			}
+		}
+		unindexed.clear();
+		for(int m=0; m<bank.models.size(); m++){
+			if(!indexed[m]){
+				unindexed.push_back(m);
+			}
+		}
+		attachedRevision = bank.revision;
+	}
+
+	vector<bool> ShortlistIndex::shortlist(rh::ModelBank &bank, const vector<int> &observation, int tolerance, int size){
+		if(attachedRevision!=bank.revision){
+			ShortlistIndex::attach(bank);
+		}
+		//the histogram as a unit vector with 0 for the extra coordinate
+		double histogram[rh::Prefilter::BINS];
+		rh::Prefilter::histogram(observation, histogram);
+		double query[DIMENSIONS];
+		double length = 0;
+		for(int k=0; k<rh::Prefilter::BINS; k++){
+			length += histogram[k]*histogram[k];
+		}
+		for(int k=0; k<rh::Prefilter::BINS; k++){
+			query[k] = length>0 ? histogram[k]/sqrt(length) : 0;
+		}
+		query[rh::Prefilter::BINS] = 0;
+
+		//the models met in the graph of every stroke count wanted, and the ones that aren't in it
+		int strokeNum = rh::ModelBank::strokes(observation);
+		vector<int> found;
+		for(map<int, int>::iterator itr=entry.begin(); itr!=entry.end(); ++itr){
+			if(tolerance>=0 && itr->first!=0 && abs(itr->first-strokeNum)>tolerance){
+				continue;
+			}
+			int top = links[itr->second].size()-1;
+			int from = ShortlistIndex::descend(query, itr->second, top, 1);
+			vector< pair<double, int> > nearest = ShortlistIndex::searchLayer(query, from, 0, SEARCH>size ? SEARCH : size);
+			for(int i=0; i<nearest.size(); i++){
+				if(itemModel[nearest[i].second]>=0){
+					found.push_back(itemModel[nearest[i].second]);
+				}
+			}
+		}
+		for(int i=0; i<unindexed.size(); i++){
+			int m = unindexed[i];
+			if(tolerance<0 || bank.models[m].strokeNum==0 || abs(bank.models[m].strokeNum-strokeNum)<=tolerance){
+				found.push_back(m);
+			}
+		}
+		//too few near the observation: the scan finds the rest
+		if(size<=0 || found.size()<size){
+			return bank.prefilter.shortlist(observation, bank.candidates(observation, tolerance), size);
+		}
+
+		vector< pair<double, int> > scores(found.size());
+		for(int i=0; i<found.size(); i++){
+			scores[i] = pair<double, int>(bank.prefilter.score(found[i], histogram), found[i]);
+		}
+		reranked += found.size();
+		partial_sort(scores.begin(), scores.begin()+size, scores.end(), ShortlistIndex::higherScore);
+		vector<bool> wanted(bank.models.size(), false);
+		for(int i=0; i<size; i++){
+			wanted[scores[i].second] = true;
+		}
+		return wanted;
+	}
+
+	//the centred signature scaled into the unit ball, and the coordinate that makes it unit length
+	void ShortlistIndex::embed(int item){
+		double *point = &points[item*DIMENSIONS];
+		double length = 0;
+		for(int k=0; k<rh::Prefilter::BINS; k++){
+			point[k] = (signature[item*rh::Prefilter::BINS+k]-centre[k])/scale;
+			length += point[k]*point[k];
+		}
+		point[rh::Prefilter::BINS] = length<1 ? sqrt(1-length) : 0;
+	}
+
+	//links the item to the nearest items of its stroke count on every layer up to level
+	void ShortlistIndex::insert(int item, int level){
+		links[item].assign(level+1, vector<int>());
+		map<int, int>::iterator itr = entry.find(strokeNums[item]);
+		if(itr==entry.end()){
+			entry[strokeNums[item]] = item;
+			return;
+		}
+		int top = links[itr->second].size()-1;
+		const double *query = &points[item*DIMENSIONS];
+		int from = ShortlistIndex::descend(query, itr->second, top, level+1);
+		for(int layer=(level<top ? level : top); layer>=0; layer--){
+			vector< pair<double, int> > nearest = ShortlistIndex::searchLayer(query, from, layer, BUILD);
+			int most = layer==0 ? 2*LINKS : LINKS;
+			links[item][layer] = ShortlistIndex::select(nearest, LINKS);
+			for(int i=0; i<links[item][layer].size(); i++){
+				int other = links[item][layer][i];
+				links[other][layer].push_back(item);
+				if(links[other][layer].size()>most){//keep the ones the heuristic keeps for the item linked to
+					vector< pair<double, int> > linked;
+					for(int j=0; j<links[other][layer].size(); j++){
+						linked.push_back(pair<double, int>(ShortlistIndex::similarity(other, links[other][layer][j]), links[other][layer][j]));
+					}
+					sort(linked.begin(), linked.end(), greater< pair<double, int> >());
+					links[other][layer] = ShortlistIndex::select(linked, most);
+				}
+			}
+			from = nearest[0].second;
+		}
+		if(level>top){
+			entry[strokeNums[item]] = item;
+		}
+	}
+
+	//greedy from layer top down to layer bottom, the nearest item it ends on
+	int ShortlistIndex::descend(const double *query, int from, int top, int bottom){
+		double best = ShortlistIndex::similarity(query, from);
+		for(int layer=top; layer>=bottom; layer--){
+			bool moved = true;
+			while(moved){
+				moved = false;
+				const vector<int> &next = links[from][layer];
+				for(int i=0; i<next.size(); i++){
+					double s = ShortlistIndex::similarity(query, next[i]);
+					if(s>best){
+						best = s;
+						from = next[i];
+						moved = true;
+					}
+				}
+			}
+		}
+		return from;
+	}
+
+	//the width nearest items to the query the search of a layer meets from the item from, nearest first
+	vector< pair<double, int> > ShortlistIndex::searchLayer(const double *query, int from, int layer, int width){
+		search++;
+		if(search<=0){//wrapped around, the marks have to start over
+			marks.assign(marks.size(), 0);
+			search = 1;
+		}
+		priority_queue< pair<double, int> > open;//nearest on top
+		priority_queue< pair<double, int>, vector< pair<double, int> >, greater< pair<double, int> > > kept;//furthest on top
+		double s = ShortlistIndex::similarity(query, from);
+		marks[from] = search;
+		open.push(pair<double, int>(s, from));
+		kept.push(pair<double, int>(s, from));
+		while(!open.empty()){
+			pair<double, int> current = open.top();
+			open.pop();
+			if(kept.size()>=width && current.first<kept.top().first){
+				break;//nothing nearer can be reached through it
+			}
+			const vector<int> &next = links[current.second][layer];
+			for(int i=0; i<next.size(); i++){
+				if(marks[next[i]]==search){
+					continue;
+				}
+				marks[next[i]] = search;
+				double t = ShortlistIndex::similarity(query, next[i]);
+				if(kept.size()<width || t>kept.top().first){
+					open.push(pair<double, int>(t, next[i]));
+					kept.push(pair<double, int>(t, next[i]));
+					if(kept.size()>width){
+						kept.pop();
+					}
+				}
+			}
+		}
+		vector< pair<double, int> > nearest(kept.size());
+		for(int i=nearest.size()-1; i>=0; i--){
+			nearest[i] = kept.top();
+			kept.pop();
+		}
+		return nearest;
+	}
+
+	//the heuristic of HNSW: an item is linked to if it is nearer the query than to any linked to so
+	//far, which keeps links into every direction; the nearest of the rest fill up to count
+	vector<int> ShortlistIndex::select(const vector< pair<double, int> > &nearest, int count) const{
+		vector<int> chosen;
+		vector<bool> taken(nearest.size(), false);
+		for(int i=0; i<nearest.size() && chosen.size()<count; i++){
+			bool diverse = true;
+			for(int j=0; j<chosen.size() && diverse; j++){
+				diverse = nearest[i].first>ShortlistIndex::similarity(nearest[i].second, chosen[j]);
+			}
+			if(diverse){
+				chosen.push_back(nearest[i].second);
+				taken[i] = true;
+			}
+		}
+		for(int i=0; i<nearest.size() && chosen.size()<count; i++){
+			if(!taken[i]){
+				chosen.push_back(nearest[i].second);
+			}
+		}
+		return chosen;
+	}
+
+	double ShortlistIndex::similarity(const double *query, int item){
+		visited++;
+		const double *point = &points[item*DIMENSIONS];
+		double sum = 0;
+		for(int k=0; k<DIMENSIONS; k++){
+			sum += query[k]*point[k];
+		}
+		return sum;
+	}
+
+	double ShortlistIndex::similarity(int a, int b) const{
+		double sum = 0;
+		for(int k=0; k<DIMENSIONS; k++){
+			sum += points[a*DIMENSIONS+k]*points[b*DIMENSIONS+k];
+		}
+		return sum;
+	}
+
+	//the layers above the bottom an item is on, each one LINKS times less likely than the one below
+	int ShortlistIndex::randomLevel(unsigned int &seed){
+		seed = seed*1664525u+1013904223u;
+		double u = ((seed>>8)+0.5)/16777216.0;
+		int level = (int)(-log(u)/log((double)LINKS));
+		return level<16 ? level : 16;
+	}
+
+	//the highest score first, the first of the bank on a tie, as Prefilter ranks them
+	bool ShortlistIndex::higherScore(const pair<double, int> &a, const pair<double, int> &b){
+		return a.first>b.first || (a.first==b.first && a.second<b.second);
+	}
+
+	bool ShortlistIndex::use(){
+		return chosenUse;
+	}
+
+	bool ShortlistIndex::chooseUse(){
+		const char *wanted = getenv("RH_INDEX");
+		return wanted!=NULL && string(wanted).compare("on")==0;
+	}
+
+	const bool ShortlistIndex::chosenUse = ShortlistIndex::chooseUse();
+}
+
+#endif //__ShortlistIndex__
@@ -0,0 +1,106 @@
+#ifndef __StrokeViterbi__
+#define __StrokeViterbi__
+
+#include <iostream>
+#include "Constants.h"
+#include "Model.h"
+
+namespace rh = redhat;
+using namespace std;
+
+namespace redhat{
+	//one column of a left-to-right model, like ColumnKernel but with the model's own tables
+	typedef void (*StrokeColumn)(const double *previous, const rh::Model &model, const double *distribution, double *next, int *path);
+
+	/* The column of a model with the stroke shape <StateNo, JumpNo> (see Model::hasShape).
+	 * The quantised models give the first state a transition into every state, so their band
+	 * reaches right across the model and ViterbiKernel ends up trying every earlier state of
+	 * every state. Here the states of a stroke are a block of StateNo with the jump band of each
+	 * state fixed at compile time, so the loops unroll; the hand-off from the stroke before and
+	 * the transition out of the first state are one extra term each. The terms are tried nearest
+	 * first with the same comparison as ViterbiKernel::calculateState, so the scores and the
+	 * previous states are the same.
+	 */
+	template<int StateNo, int JumpNo>
+	class StrokeKernel{
+		public:
+			static void column(const double *previous, const rh::Model &model, const double *distribution, double *next, int *path);
+			static void scoreColumn(const double *previous, const rh::Model &model, const double *distribution, double *next, int *path);
+		private:
+			template<bool withPath> static void calculate(const double *previous, const rh::Model &model, const double *distribution, double *next, int *path);
+	};
+
+	template<int StateNo, int JumpNo> template<bool withPath>
+	void StrokeKernel<StateNo, JumpNo>::calculate(const double *previous, const rh::Model &model, const double *distribution, double *next, int *path){
+		int stateNum = model.stateNum;
+		const double *bandTran = &model.bandTran[0];
+		const double *fromFirst = &model.logTran[0];//the transitions out of the first state
+		for(int first=0; first<stateNum; first+=StateNo){
+			for(int q=0; q<StateNo; q++){
+				int j = first+q;
+				double best = previous[j]+bandTran[j];
+				int bestPath = j;
+				for(int d=1; d<=JumpNo && d<=q; d++){
+					double temp = previous[j-d]+bandTran[d*stateNum+j];
+					if(temp>best){
+						best = temp;
+						bestPath = j-d;
+					}
+				}
+				if(q==0 && first>0){//from the last state of the stroke before
+					double temp = previous[j-1]+bandTran[stateNum+j];
+					if(temp>best){
+						best = temp;
+						bestPath = j-1;
+					}
+				}
+				if(first>0 || q>JumpNo){//from the first state, unless the band already covered it
+					double temp = previous[0]+fromFirst[j];
+					if(temp>best){
+						best = temp;
+						bestPath = 0;
+					}
+				}
+				next[j] = best+distribution[j];
+				if(withPath){
+					path[j] = best==LOGZERO ? stateNum-1 : bestPath;
+				}
+			}
+		}
+	}
+
+	template<int StateNo, int JumpNo>
+	void StrokeKernel<StateNo, JumpNo>::column(const double *previous, const rh::Model &model, const double *distribution, double *next, int *path){
+		StrokeKernel<StateNo, JumpNo>::calculate<true>(previous, model, distribution, next, path);
+	}
+
+	template<int StateNo, int JumpNo>
+	void StrokeKernel<StateNo, JumpNo>::scoreColumn(const double *previous, const rh::Model &model, const double *distribution, double *next, int * /*path*/){
+		StrokeKernel<StateNo, JumpNo>::calculate<false>(previous, model, distribution, next, NULL);
+	}
+
+	/* Picks the StrokeKernel for the shape Model::load found, one instantiation per entry of SHAPES.
+	 * A model without one of these shapes gets NULL and is decoded with ViterbiKernel.
+	 */
+	class StrokeViterbi{
+		public:
+			static StrokeColumn kernel(const rh::Model &model);
+			static StrokeColumn scoreKernel(const rh::Model &model);
+	};
+
+	StrokeColumn StrokeViterbi::kernel(const rh::Model &model){
+		if(model.strokeStateNum==3 && model.strokeJumpNo==2) return StrokeKernel<3, 2>::column;
+		if(model.strokeStateNum==5 && model.strokeJumpNo==3) return StrokeKernel<5, 3>::column;
+		if(model.strokeStateNum==8 && model.strokeJumpNo==4) return StrokeKernel<8, 4>::column;
+		return NULL;
+	}
+
+	StrokeColumn StrokeViterbi::scoreKernel(const rh::Model &model){
+		if(model.strokeStateNum==3 && model.strokeJumpNo==2) return StrokeKernel<3, 2>::scoreColumn;
+		if(model.strokeStateNum==5 && model.strokeJumpNo==3) return StrokeKernel<5, 3>::scoreColumn;
+		if(model.strokeStateNum==8 && model.strokeJumpNo==4) return StrokeKernel<8, 4>::scoreColumn;
+		return NULL;
+	}
+}
+
+#endif //__StrokeViterbi__
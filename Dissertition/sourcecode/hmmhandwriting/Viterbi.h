@@ -1,4 +1,8 @@
+#ifndef __Viterbi__
+#define __Viterbi__
+
 #include <iostream>
+#include <algorithm>
 #include <math.h>
 #include "Stroke.h"
 #include <string>
@@ -7,7 +11,12 @@
 #include <boost/filesystem/fstream.hpp>
 #include <boost/filesystem/path.hpp>
 #include "convert.h"
-#include "Node.h"
+#include "Model.h"
+#include "ViterbiKernel.h"
+#include "StrokeViterbi.h"
+#include "Arena.h"
+#include "Backpointers.h"
+#include "DecoderWorkspace.h"
 #include "ViterbiResult.h"
 
 namespace rh = redhat;
@@ -17,54 +26,31 @@ using namespace std;
 namespace redhat{
 	class Viterbi{
 		public:
-			static rh::ViterbiResult Calculate_path_and_probability(string distributionProbabilityFilePath, string observationFilePath, string transitionProbabilityFilePath);
+			static rh::ViterbiResult Calculate_path_and_probability(const string &distributionProbabilityFilePath, const string &observationFilePath, const string &transitionProbabilityFilePath);
+			static rh::ViterbiResult Calculate_path_and_probability(const rh::Model &model, const vector<int> &observation);
+			static double Calculate_probability(const string &distributionProbabilityFilePath, const string &observationFilePath, const string &transitionProbabilityFilePath);
+			static double Calculate_probability(const rh::Model &model, const vector<int> &observation);
+			static vector<int> readObservation(const string &observationFilePath);
 			static vector<int> insertIntoVector(int num, vector<int> pathVector);
+			static rh::ViterbiResult Calculate_path_checkpointed(const rh::Model &model, const vector<int> &observation);
+			static double decode(const rh::Model &model, const vector<int> &observation, rh::DecoderWorkspace &workspace);
+			static double decodeCheckpointed(const rh::Model &model, const vector<int> &observation, rh::DecoderWorkspace &workspace);
+			static void calculateNode(const double *previous, const rh::Model &model, int j, double distribution, double *next, int *path);
+			static void calculateColumn(const rh::Model &model, int symbol, int &currentStrokeNum, const double *previous, double *next, int *path, rh::ColumnKernel kernel, rh::StrokeColumn strokeKernel);
+
+			static const int CHECKPOINT_NODES = 1<<21;//above this many nodes the full decode switches to checkpoints
 	};
 	
-	rh::ViterbiResult Viterbi::Calculate_path_and_probability(string distributionProbabilityFilePath, string observationFilePath, string transitionProbabilityFilePath){
-		
-		//create two 2D array to store the distribtion and transition probability
-		double disProb[100][16];
-		double tranProb[100][100];
-		
-		int disRow=0;//used to locate the value in the 2D array
-		int disColumn=0;
-		int tranRow=0;//tranRow should equal tranColumn, since the transition probability matrix should be a square matrix.
-		int tranColumn=0;
-		
+	rh::ViterbiResult Viterbi::Calculate_path_and_probability(const string &distributionProbabilityFilePath, const string &observationFilePath, const string &transitionProbabilityFilePath){
+		rh::Model model;
+		model.load(distributionProbabilityFilePath, transitionProbabilityFilePath);
+		vector<int> observation = Viterbi::readObservation(observationFilePath);
+		return Viterbi::Calculate_path_and_probability(model, observation);
+	}
+	
+	vector<int> Viterbi::readObservation(const string &observationFilePath){
 		vector<int> observation;
-		
 		string line;//used to retrieve each line in a file
-		double num;// used to get double format value of line;
-		
-		//populate the two 2D arrays
-		fs::ifstream disProbFile(distributionProbabilityFilePath);
-		if(!disProbFile){
-			cout<<"Cannot open file.\n";
-		}else{
-			while(!disProbFile.eof()){
-				getline(disProbFile, line);
-				if(line.compare("")==0){//do nothing
-				}else{
-					num=rh::convertToDouble(line);
-					disProb[disRow][disColumn]=num;
-					disColumn++;
-					if(disColumn==16) disRow++;
-					disColumn = disColumn%16;
-				}
-			}
-		}
-		disProbFile.close();
-		
-		//for testing
-		//testing start
-		/*cout<<"Distribution File:"<<endl<<endl;
-		for(int i=0; i<disRow; i++){
-			for(int j=0; j<16; j++){
-				cout<<disProb[i][j]<<"\t";
-			}
-			cout<<endl;
-		}//testing finish*/
 		
 		fs::ifstream observationFile(observationFilePath);
 		if(!observationFile){
@@ -74,74 +60,60 @@ namespace redhat{
 				getline(observationFile, line);
 				if(line.compare("")==0){//do nothing
 				}else{
-					num=rh::convertToDouble(line);
-					observation.push_back(num);
+					observation.push_back(rh::convertToDouble(line));
 				}
 			}
 		}
-		//tst
-//		for(int i=0; i<observation.size(); i++){
-//			cout<<i<<" "<<observation.at(i)<<"\t";	
-//		}
-//		cout<<endl;
-		//end tst
 		observationFile.close();
-		
-		/*cout<<"Observation File:"<<endl<<endl;
-		//for testing
-		//testing start
-		for(int i=0; i<observation.size(); i++){
-			cout<<observation.at(i)<<endl;
-		}//testing finish*/
+		return observation;
+	}
 	
-		
-		fs::ifstream tranProbFile(transitionProbabilityFilePath);
-		if(!tranProbFile){
-			cout<<"Cannot open file.\n";
-		}else{
-			while(!tranProbFile.eof()){
-				getline(tranProbFile, line);
-				if(line.compare("newRow")==0){
-					tranColumn=0;
-					tranRow++;
-				}else if(line.compare("")==0){// do nothing
-				}else{
-					num=rh::convertToDouble(line);
-					tranProb[tranRow][tranColumn]=num;
-					tranColumn++;
-				}
-			}
-		}
-		tranProbFile.close();
-		
-//		cout<<"Transition File:"<<endl<<endl;
-//		//testing start
-//		for(int i=0; i<=tranRow; i++){
-//			for(int j=0; j<tranColumn; j++){
-//				cout<<tranProb[i][j]<<"\t";
-//			}
-//			cout<<endl;
-//		}//testing finish
-		
-		
-		
+	rh::ViterbiResult Viterbi::Calculate_path_and_probability(const rh::Model &model, const vector<int> &observation){
+		rh::DecoderWorkspace &workspace = rh::DecoderWorkspace::local();
+		rh::ViterbiResult result;
+		result.probability = Viterbi::decode(model, observation, workspace);
+		result.path = workspace.path;
+		return result;
+	}
+	
+	/* Full decoding into a workspace the caller keeps: the probability is returned and the state
+	 * path is left in workspace.path, one state per observation with the last entry the current
+	 * state of the last observation (-1 when the path ran into a node the stroke markers ruled out).
+	 */
+	double Viterbi::decode(const rh::Model &model, const vector<int> &observation, rh::DecoderWorkspace &workspace){
+		int tranColumn = model.stateNum;//tranColumn represent the row number
 		int matrixColumn = observation.size();
 //		int rows = 3;
-		rh::Node matrix[100][500];
+		workspace.path.clear();
+		workspace.probability = rh::LOGZERO;
+		int firstSymbol = observation.at(0);
+		if(tranColumn==0){//the model files could not be read, there is no state to end in
+			return workspace.probability;
+		}
+		if((double)matrixColumn*tranColumn>CHECKPOINT_NODES){//too long to keep every column, work segments out again during backtracking
+			return Viterbi::decodeCheckpointed(model, observation, workspace);
+		}
 		
-		double maxProbability = 0;
-		rh::Node maxNode;
+		//only the last two columns of scores are needed, the previous state of every node of the trellis
+		//is kept in a packed bit array. all of it is sized from the model and the observation and comes
+		//from the workspace.
+		rh::Arena &arena = workspace.arena;
+		size_t arenaMark = arena.mark();
+		double *previous = arena.allocate<double>(tranColumn);
+		double *next = arena.allocate<double>(tranColumn);
+		int *path = arena.allocate<int>(tranColumn);//previous states of the column being worked out
+		rh::Backpointers backpointers;
+		backpointers.reset(arena, tranColumn, matrixColumn, model.jumpWidth, model.leftToRight);
+		rh::ColumnKernel kernel = rh::ViterbiKernel::kernel();
+		rh::StrokeColumn strokeKernel = rh::StrokeViterbi::kernel(model);
 		
-		vector <int> mostPossiblePath;
+		double maxProbability = 0;
 		
 		//initialization viterbi
-		matrix[0][0].probability = log(disProb[0][observation.at(0)-16]);
-		matrix[0][0].path = 0;
-		matrix[0][0].currentPath = 0;
+		previous[0] = model.emission(firstSymbol)[0];
 		
 		for(int i=1; i<tranColumn; i++){
-			matrix[i][0].probability = log(0.0);
-			matrix[i][0].path = 0;
+			previous[i] = rh::LOGZERO;
 		}
 		//recursion
 //		for(int i=1; i<matrixColumn; i++){//calculate column by column
@@ -176,107 +148,9 @@ namespace redhat{
 		int currentStrokeNum = 1;
 //		cout<<"initial stroke number: "<<currentStrokeNum<<endl;
 		for(int i=1; i<matrixColumn; i++){//calculate column by column
-			if(observation.at(i)>15){//process the first state in each stroke: the staring state = vector number+16
-				currentStrokeNum++;
-//				cout<<"stroke number: "<<currentStrokeNum<<endl;
-				for(int j=0; j<tranColumn; j++){//calculate each node //tranColumn represent the row number	
-					if(j==(currentStrokeNum-1)*rh::STATENO){
-						double maxProbAtPresent = 0;
-						double maxPathProbAtPresent = 0;
-						int maxPath = 0;//default is from the state one.
-						for(int k=0; k<tranColumn; k++){//calculate every previous node
-							double tempProb = matrix[k][i-1].probability+log(tranProb[k][j])+log(disProb[j][observation.at(i)-16]);
-							double tempPathProb = matrix[k][i-1].probability+log(tranProb[k][j]);
-							if (maxProbAtPresent == 0){
-								maxProbAtPresent=tempProb;
-							}
-							if (maxPathProbAtPresent == 0){
-								maxPathProbAtPresent=tempPathProb;
-							}
-							if (tempProb>=maxProbAtPresent){
-								maxProbAtPresent=tempProb;
-							}
-							if (tempPathProb >= maxPathProbAtPresent){
-								maxPathProbAtPresent = tempPathProb;
-								maxPath = k;
-							}
-						}
-						matrix[j][i].probability = maxProbAtPresent;
-						matrix[j][i].path = maxPath;
-						matrix[j][i].currentPath = j;
-//						//tst
-//						cout<<"begin at "<<i<<endl;
-//						//tst end
-					}else{
-						matrix[j][i].probability=log(0.0);
-						matrix[j][i].path = -1;
-					}
-				}
-			}else if(observation.at(i)<0){//process the last state in each stroke: the ending state = vector number -16
-				for(int j=0; j<tranColumn; j++){//calculate each node //tranColumn represent the row number	
-					if(j==(currentStrokeNum*rh::STATENO)-1){
-						double maxProbAtPresent = 0;
-						double maxPathProbAtPresent = 0;
-						int maxPath = 0;//default is from the state one.
-						for(int k=0; k<tranColumn; k++){//calculate every previous node
-							double tempProb = matrix[k][i-1].probability+log(tranProb[k][j])+log(disProb[j][observation.at(i)+16]);
-							double tempPathProb = matrix[k][i-1].probability+log(tranProb[k][j]);
-							if (maxProbAtPresent == 0){
-								maxProbAtPresent=tempProb;
-							}
-							if (maxPathProbAtPresent == 0){
-								maxPathProbAtPresent=tempPathProb;
-							}
-							if (tempProb>=maxProbAtPresent){
-								maxProbAtPresent=tempProb;
-							}
-							if (tempPathProb >= maxPathProbAtPresent){
-								maxPathProbAtPresent = tempPathProb;
-								maxPath = k;	
-							}
-						}
-//						cout<<maxProbAtPresent<<endl;
-						matrix[j][i].probability = maxProbAtPresent;
-						matrix[j][i].path = maxPath;
-						matrix[j][i].currentPath = j;
-//						//tst
-//						cout<<"end at "<<i<<endl;
-//						cout<<"state end at "<<j<<endl;
-//						cout<<matrix[j][i].probability<<endl<<endl;;
-					}else{
-						matrix[j][i].probability=log(0.0);
-						matrix[j][i].path = -2;
-					}
-				}
-			}else{
-				for(int j=0; j<tranColumn; j++){//calculate each node //tranColumn represent the row number	
-//					cout<<"good so far4\n";
-					//for normal state processing
-					double maxProbAtPresent = 0;
-					double maxPathProbAtPresent = 0;
-					int maxPath = 0;//default is from the state one.
-					for(int k=0; k<tranColumn; k++){//calculate every previous node
-						double tempProb = matrix[k][i-1].probability+log(tranProb[k][j])+log(disProb[j][observation.at(i)]);
-						double tempPathProb = matrix[k][i-1].probability+log(tranProb[k][j]);
-						if (maxProbAtPresent == 0){
-							maxProbAtPresent=tempProb;
-						}
-						if (maxPathProbAtPresent == 0){
-							maxPathProbAtPresent=tempPathProb;
-						}
-						if (tempProb>=maxProbAtPresent){
-							maxProbAtPresent=tempProb;
-						}
-						if (tempPathProb >= maxPathProbAtPresent){
-							maxPathProbAtPresent = tempPathProb;
-							maxPath = k;	
-						}
-					}
-					matrix[j][i].probability = maxProbAtPresent;
-					matrix[j][i].path = maxPath;
-					matrix[j][i].currentPath = j;
-				}
-			}
+			Viterbi::calculateColumn(model, observation.at(i), currentStrokeNum, previous, next, path, kernel, strokeKernel);
+			backpointers.setColumn(i, path);
+			std::swap(previous, next);
 		}	
 		
 //		//for testing
@@ -318,33 +192,296 @@ namespace redhat{
 //				}
 //			}
 			//it should always be ending at the last state.
-			maxProbability = matrix[tranColumn-1][matrixColumn-1].probability;
-			maxNode = matrix[tranColumn-1][matrixColumn-1];
+			maxProbability = previous[tranColumn-1];
 		}catch(...){
 			cout<<"Exception while gettign the max node\n";
 		}
 		
 		try{
 			//state path backtracking
-			mostPossiblePath.push_back(maxNode.path);
-			mostPossiblePath.push_back(maxNode.currentPath);
-//			cout<<maxNode.path<<"\t"<<maxNode.currentPath<<endl;
-			int previousPath = maxNode.path;
+			//a node that was never reached (first column, or not the state an end of stroke forces) has no current state
+			//the first column has no previous states, its nodes all point at the first state.
+			//the path is written from the back, straight into its place.
+			int lastPath = matrixColumn>1 ? backpointers.get(matrixColumn-1, tranColumn-1) : 0;
+			int currentPath = tranColumn-1;
+			if(lastPath<0||(matrixColumn==1&&tranColumn>1)){
+				currentPath = -1;
+			}
+			vector<int> &mostPossiblePath = workspace.path;
+			mostPossiblePath.resize(matrixColumn>1 ? matrixColumn : 2);
+			mostPossiblePath[mostPossiblePath.size()-1] = currentPath;
+			mostPossiblePath[mostPossiblePath.size()-2] = lastPath;
+			int previousPath = lastPath;
 			for(int i = matrixColumn-2; i > 0; i--){
-//				cout<<previousPath<<endl;
-				previousPath = matrix[previousPath][i].path;
-				mostPossiblePath = Viterbi::insertIntoVector(previousPath, mostPossiblePath);
+				if(previousPath>=0){//stop following a path that ran into a node the stroke markers ruled out
+					previousPath = backpointers.get(i, previousPath);
+				}
+				mostPossiblePath[i-1] = previousPath;
 			}
 		}catch(...){
 //			cout<<"Execption while backtracking for file: "+observationFilePath+"\n";//used for debug
 		}
 		
+		arena.release(arenaMark);
+		
+		workspace.probability = maxProbability;
+		return maxProbability;
+	}
+	
+	
+	double Viterbi::Calculate_probability(const string &distributionProbabilityFilePath, const string &observationFilePath, const string &transitionProbabilityFilePath){
+		rh::Model model;
+		model.load(distributionProbabilityFilePath, transitionProbabilityFilePath);
+		vector<int> observation = Viterbi::readObservation(observationFilePath);
+		return Viterbi::Calculate_probability(model, observation);
+	}
+	
+	/* Score-only decoding: the same recursion as Calculate_path_and_probability, but without
+	 * backpointers or traceback. Only two columns of scores are kept and used in turn.
+	 */
+	double Viterbi::Calculate_probability(const rh::Model &model, const vector<int> &observation){
+		int tranColumn = model.stateNum;
+		int firstSymbol = observation.at(0);
+		if(tranColumn==0){
+			return rh::LOGZERO;
+		}
+		rh::Arena &arena = rh::Arena::local();
+		size_t arenaMark = arena.mark();
+		double *previous = arena.allocate<double>(tranColumn);
+		double *next = arena.allocate<double>(tranColumn);
+		rh::ScoreKernel kernel = rh::ViterbiKernel::scoreKernel();
+		rh::StrokeColumn strokeKernel = rh::StrokeViterbi::scoreKernel(model);
+		
+		previous[0] = model.emission(firstSymbol)[0];
+		for(int j=1; j<tranColumn; j++){
+			previous[j] = rh::LOGZERO;
+		}
+		
+		int currentStrokeNum = 1;
+		for(int i=1; i<observation.size(); i++){
+			int symbol = observation.at(i);
+			const double *distribution = model.emission(symbol);//the distribution of every state, in a row
+			if(symbol>15||symbol<0){//only the first state of a stroke at its start, and the last state at its end
+				int forcedState;
+				if(symbol>15){
+					currentStrokeNum++;
+					forcedState = (currentStrokeNum-1)*rh::STATENO;
+				}else{
+					forcedState = currentStrokeNum*rh::STATENO-1;
+				}
+				for(int j=0; j<tranColumn; j++){
+					next[j] = rh::LOGZERO;
+				}
+				if(forcedState<tranColumn){
+					Viterbi::calculateNode(previous, model, forcedState, distribution[forcedState], next, NULL);
+				}
+			}else if(model.leftToRight){
+				if(strokeKernel!=NULL){
+					strokeKernel(previous, model, distribution, next, NULL);
+				}else{
+					kernel(previous, &model.bandTran[0], &model.logTran[0], tranColumn, model.jumpWidth, distribution, next);
+				}
+			}else{
+				for(int j=0; j<tranColumn; j++){
+					Viterbi::calculateNode(previous, model, j, distribution[j], next, NULL);
+				}
+			}
+			double *swap = previous;
+			previous = next;
+			next = swap;
+		}
+		
+		//it should always be ending at the last state.
+		double probability = previous[tranColumn-1];
+		arena.release(arenaMark);
+		return probability;
+	}
+	
+	/* Full decoding for very long observations, e.g. whole sentences. Instead of the previous
+	 * states of every column it keeps the scores of every K-th column, with K about the square root
+	 * of the number of observations. Backtracking goes through the segments between these
+	 * checkpoints from the last to the first, working each one out again from its checkpoint and
+	 * keeping the previous states of that segment only. The recursion is the same as the full
+	 * decode's, so the path and the probability are the same too, for O(stateNum*sqrt(T)) memory
+	 * and about twice the work.
+	 */
+	rh::ViterbiResult Viterbi::Calculate_path_checkpointed(const rh::Model &model, const vector<int> &observation){
+		rh::DecoderWorkspace &workspace = rh::DecoderWorkspace::local();
 		rh::ViterbiResult result;
-		result.probability = maxProbability;
-		result.path = mostPossiblePath;
+		result.probability = Viterbi::decodeCheckpointed(model, observation, workspace);
+		result.path = workspace.path;
 		return result;
 	}
 	
+	double Viterbi::decodeCheckpointed(const rh::Model &model, const vector<int> &observation, rh::DecoderWorkspace &workspace){
+		int tranColumn = model.stateNum;
+		int matrixColumn = observation.size();
+		workspace.path.clear();
+		workspace.probability = rh::LOGZERO;
+		int firstSymbol = observation.at(0);
+		if(tranColumn==0){
+			return workspace.probability;
+		}
+		int segment = 1;
+		while(segment*segment<matrixColumn){
+			segment++;
+		}
+		int checkpointNum = (matrixColumn-1)/segment+1;//column c*segment is kept as checkpoint c
+		
+		rh::Arena &arena = workspace.arena;
+		size_t arenaMark = arena.mark();
+		double *checkpoint = arena.allocate<double>(checkpointNum*tranColumn);
+		int *checkpointStroke = arena.allocate<int>(checkpointNum);//stroke number at each checkpoint
+		double *previous = arena.allocate<double>(tranColumn);
+		double *next = arena.allocate<double>(tranColumn);
+		int *path = arena.allocate<int>(tranColumn);
+		rh::Backpointers backpointers;
+		backpointers.reset(arena, tranColumn, segment, model.jumpWidth, model.leftToRight);
+		rh::ColumnKernel kernel = rh::ViterbiKernel::kernel();
+		rh::StrokeColumn strokeKernel = rh::StrokeViterbi::kernel(model);
+		
+		//forward pass, keeping only the checkpoints
+		previous[0] = model.emission(firstSymbol)[0];
+		for(int j=1; j<tranColumn; j++){
+			previous[j] = rh::LOGZERO;
+		}
+		int currentStrokeNum = 1;
+		for(int j=0; j<tranColumn; j++){
+			checkpoint[j] = previous[j];
+		}
+		checkpointStroke[0] = currentStrokeNum;
+		for(int i=1; i<matrixColumn; i++){
+			Viterbi::calculateColumn(model, observation.at(i), currentStrokeNum, previous, next, path, kernel, strokeKernel);
+			std::swap(previous, next);
+			if(i%segment==0){
+				for(int j=0; j<tranColumn; j++){
+					checkpoint[(i/segment)*tranColumn+j] = previous[j];
+				}
+				checkpointStroke[i/segment] = currentStrokeNum;
+			}
+		}
+		//it should always be ending at the last state.
+		double probability = previous[tranColumn-1];
+		
+		//backtracking, one segment at a time. the path holds the state of every column before the
+		//last one, then the current state of the last column, as the full decode gives it.
+		vector<int> &statePath = workspace.path;
+		statePath.resize(matrixColumn>1 ? matrixColumn : 2);
+		if(matrixColumn==1){
+			statePath[0] = 0;
+			statePath[1] = tranColumn>1 ? -1 : tranColumn-1;
+		}else{
+			int state = tranColumn-1;
+			for(int c=(matrixColumn-2)/segment; c>=0; c--){
+				int first = c*segment+1;//columns first..last are worked out again from checkpoint c
+				int last = first+segment-1<matrixColumn-1 ? first+segment-1 : matrixColumn-1;
+				for(int j=0; j<tranColumn; j++){
+					previous[j] = checkpoint[c*tranColumn+j];
+				}
+				currentStrokeNum = checkpointStroke[c];
+				backpointers.clear();
+				for(int i=first; i<=last; i++){
+					Viterbi::calculateColumn(model, observation.at(i), currentStrokeNum, previous, next, path, kernel, strokeKernel);
+					backpointers.setColumn(i-first, path);
+					std::swap(previous, next);
+				}
+				for(int i=last; i>=first; i--){
+					if(state>=0){//stop following a path that ran into a node the stroke markers ruled out
+						state = backpointers.get(i-first, state);
+					}
+					statePath[i-1] = state;
+				}
+			}
+			statePath[matrixColumn-1] = statePath[matrixColumn-2]<0 ? -1 : tranColumn-1;
+		}
+		
+		arena.release(arenaMark);
+		
+		workspace.probability = probability;
+		return probability;
+	}
+	
+	//one step of the recursion: the scores and previous states of column i from those of column i-1
+	void Viterbi::calculateColumn(const rh::Model &model, int symbol, int &currentStrokeNum, const double *previous, double *next, int *path, rh::ColumnKernel kernel, rh::StrokeColumn strokeKernel){
+		int tranColumn = model.stateNum;
+		const double *distribution = model.emission(symbol);//the distribution of every state, in a row
+		if(symbol>15||symbol<0){//only the first state of a stroke at its start, and the last state at its end
+			int forcedState;
+			int ruledOut;
+			if(symbol>15){//the staring state = vector number+16
+				currentStrokeNum++;
+				forcedState = (currentStrokeNum-1)*rh::STATENO;
+				ruledOut = -1;
+			}else{//the ending state = vector number -16
+				forcedState = currentStrokeNum*rh::STATENO-1;
+				ruledOut = -2;
+			}
+			for(int j=0; j<tranColumn; j++){
+				next[j] = rh::LOGZERO;
+				path[j] = ruledOut;
+			}
+			if(forcedState<tranColumn){
+				Viterbi::calculateNode(previous, model, forcedState, distribution[forcedState], next, path);
+			}
+		}else if(model.leftToRight){//the whole column in one go
+			if(strokeKernel!=NULL){
+				strokeKernel(previous, model, distribution, next, path);
+			}else{
+				kernel(previous, &model.bandTran[0], &model.logTran[0], tranColumn, model.jumpWidth, distribution, next, path);
+			}
+		}else{
+			for(int j=0; j<tranColumn; j++){
+				Viterbi::calculateNode(previous, model, j, distribution[j], next, path);
+			}
+		}
+	}
+	
+	//a single node for models the column kernel can't handle, and for the states forced at the ends of strokes.
+	//in the trained models the first state's row reaches every state, so the band of j is states 0..j; after
+	//the first state it goes on from j-jumpWidth, the rows in between don't reach j (see Model::jumpWidth).
+	//their terms are LOGZERO, which leave the maxima and, since a later term always follows, the path alone
+	void Viterbi::calculateNode(const double *previous, const rh::Model &model, int j, double distribution, double *next, int *path){
+		int bandStart = model.bandStart[j];
+		int bandEnd = model.bandEnd[j];
+		double maxProbAtPresent = 0;
+		double maxPathProbAtPresent = 0;
+		int maxPath = 0;//default is from the state one.
+		for(int k=bandStart; k<=bandEnd; k++){//only the previous nodes inside the band can reach this node
+			double tempPathProb = previous[k]+model.transition(k, j);
+			double tempProb = tempPathProb+distribution;
+			if (maxProbAtPresent == 0){
+				maxProbAtPresent=tempProb;
+			}
+			if (maxPathProbAtPresent == 0){
+				maxPathProbAtPresent=tempPathProb;
+			}
+			if (tempProb>=maxProbAtPresent){
+				maxProbAtPresent=tempProb;
+			}
+			if (tempPathProb >= maxPathProbAtPresent){
+				maxPathProbAtPresent = tempPathProb;
+				maxPath = k;
+			}
+			if(k==0 && maxProbAtPresent!=0 && maxPathProbAtPresent!=0 && j-model.jumpWidth>1){//a 0 sentinel would take a LOGZERO
+				k = j-model.jumpWidth-1;
+			}
+		}
+		//the nodes after the band all give LOGZERO. Looping over them would replace a 0 sentinel
+		//and move a LOGZERO maximum onto the last state, so do the same here to keep the old path.
+		if(bandEnd<model.stateNum-1){
+			if(maxProbAtPresent==0){
+				maxProbAtPresent=rh::LOGZERO;
+			}
+			if(maxPathProbAtPresent==0||maxPathProbAtPresent==rh::LOGZERO){
+				maxPathProbAtPresent=rh::LOGZERO;
+				maxPath=model.stateNum-1;
+			}
+		}
+		next[j] = maxProbAtPresent;
+		if(path!=NULL){
+			path[j] = maxPath;
+		}
+	}
 	
 	vector<int> Viterbi::insertIntoVector(int num, vector<int> pathVector){
 		vector<int>::iterator theIterator = pathVector.begin();
@@ -352,4 +489,6 @@ namespace redhat{
 		return pathVector;
 	}
 
-}
\ No newline at end of file
+}
+
+#endif //__Viterbi__
\ No newline at end of file
@@ -0,0 +1,364 @@
+#ifndef __ViterbiKernel__
+#define __ViterbiKernel__
+
+#include <iostream>
+#include <stdlib.h>
+#include <string>
+#include "Constants.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define RH_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+//gcc only emits the wider instructions inside functions marked for them, cl always does
+#if defined(RH_X86) && defined(__GNUC__)
+#define RH_TARGET(isa) __attribute__((target(isa)))
+#else
+#define RH_TARGET(isa)
+#endif
+
+using namespace std;
+
+namespace redhat{
+	/* One column of the left-to-right Viterbi recursion, computed for every state at once.
+	 * It is a max-plus matrix-vector product over the band of the model:
+	 *   pathScore[j] = max over d in [0, jumpWidth] of previous[j-d] + bandTran[d*stateNum+j],
+	 *                  and previous[0] + fromFirst[j] for j past jumpWidth
+	 *   next[j] = pathScore[j] + distribution[j]
+	 * path[j] is the predecessor j-d, or 0. The trained models' first state reaches every state,
+	 * so their band is the whole column; with Model::jumpWidth and the first state's row apart,
+	 * as in StrokeViterbi, a column is O(stateNum*(jumpWidth+2)) rather than O(stateNum^2). The
+	 * first state is tried last, where it was in the band, and a NULL fromFirst leaves it out.
+	 * On a tie the nearest predecessor wins, which is what the >= comparison over increasing k
+	 * gave in the old loop, and a LOGZERO node points at the last state like before. The 0
+	 * sentinel of the old loop is not reproduced; it only makes a difference for a log-score of
+	 * exactly 0.
+	 */
+	typedef void (*ColumnKernel)(const double *previous, const double *bandTran, const double *fromFirst, int stateNum, int jumpWidth, const double *distribution, double *next, int *path);
+	typedef void (*ScoreKernel)(const double *previous, const double *bandTran, const double *fromFirst, int stateNum, int jumpWidth, const double *distribution, double *next);//the same column without the backpointers
+
+	class ViterbiKernel{
+		public:
+			static void scalar(const double *previous, const double *bandTran, const double *fromFirst, int stateNum, int jumpWidth, const double *distribution, double *next, int *path);
+			static void scalarScore(const double *previous, const double *bandTran, const double *fromFirst, int stateNum, int jumpWidth, const double *distribution, double *next);
+#ifdef RH_X86
+			static void sse42(const double *previous, const double *bandTran, const double *fromFirst, int stateNum, int jumpWidth, const double *distribution, double *next, int *path);
+			static void sse42Score(const double *previous, const double *bandTran, const double *fromFirst, int stateNum, int jumpWidth, const double *distribution, double *next);
+			static void avx2(const double *previous, const double *bandTran, const double *fromFirst, int stateNum, int jumpWidth, const double *distribution, double *next, int *path);
+			static void avx2Score(const double *previous, const double *bandTran, const double *fromFirst, int stateNum, int jumpWidth, const double *distribution, double *next);
+			static void avx512(const double *previous, const double *bandTran, const double *fromFirst, int stateNum, int jumpWidth, const double *distribution, double *next, int *path);
+			static void avx512Score(const double *previous, const double *bandTran, const double *fromFirst, int stateNum, int jumpWidth, const double *distribution, double *next);
+#endif
+			static ColumnKernel kernel();//the widest kernel this machine can run, picked once
+			static ScoreKernel scoreKernel();
+			static string isa();
+			static bool hasAvx2();//the avx2 or the avx512f kernel was picked
+			static bool hasAvx512();
+		private:
+			template<bool withPath> static void calculateState(const double *previous, const double *bandTran, const double *fromFirst, int stateNum, int jumpWidth, const double *distribution, double *next, int *path, int j);
+#ifdef RH_X86
+			template<bool withPath> static void sse42Column(const double *previous, const double *bandTran, const double *fromFirst, int stateNum, int jumpWidth, const double *distribution, double *next, int *path);
+			template<bool withPath> static void avx2Column(const double *previous, const double *bandTran, const double *fromFirst, int stateNum, int jumpWidth, const double *distribution, double *next, int *path);
+			template<bool withPath> static void avx512Column(const double *previous, const double *bandTran, const double *fromFirst, int stateNum, int jumpWidth, const double *distribution, double *next, int *path);
+#endif
+			static bool cpuSupports(string isa);
+			static string chooseIsa();
+			static ColumnKernel chooseKernel();
+			static ScoreKernel chooseScoreKernel();
+
+			static const string chosenIsa;
+			static const bool chosenAvx2;
+			static const bool chosenAvx512;
+			static const ColumnKernel chosenKernel;
+			static const ScoreKernel chosenScoreKernel;
+	};
+
+	template<bool withPath>
+	void ViterbiKernel::calculateState(const double *previous, const double *bandTran, const double *fromFirst, int stateNum, int jumpWidth, const double *distribution, double *next, int *path, int j){
+		double best = previous[j]+bandTran[j];
+		int bestPath = j;
+		for(int d=1; d<=jumpWidth && d<=j; d++){
+			double temp = previous[j-d]+bandTran[d*stateNum+j];
+			if(temp>best){
+				best = temp;
+				bestPath = j-d;
+			}
+		}
+		if(fromFirst!=NULL && j>jumpWidth){
+			double temp = previous[0]+fromFirst[j];
+			if(temp>best){
+				best = temp;
+				bestPath = 0;
+			}
+		}
+		next[j] = best+distribution[j];
+		if(withPath){
+			path[j] = best==LOGZERO ? stateNum-1 : bestPath;
+		}
+	}
+
+	void ViterbiKernel::scalar(const double *previous, const double *bandTran, const double *fromFirst, int stateNum, int jumpWidth, const double *distribution, double *next, int *path){
+		for(int j=0; j<stateNum; j++){
+			ViterbiKernel::calculateState<true>(previous, bandTran, fromFirst, stateNum, jumpWidth, distribution, next, path, j);
+		}
+	}
+
+	void ViterbiKernel::scalarScore(const double *previous, const double *bandTran, const double *fromFirst, int stateNum, int jumpWidth, const double *distribution, double *next){
+		for(int j=0; j<stateNum; j++){
+			ViterbiKernel::calculateState<false>(previous, bandTran, fromFirst, stateNum, jumpWidth, distribution, next, NULL, j);
+		}
+	}
+
+#ifdef RH_X86
+	template<bool withPath> RH_TARGET("sse4.2")
+	void ViterbiKernel::sse42Column(const double *previous, const double *bandTran, const double *fromFirst, int stateNum, int jumpWidth, const double *distribution, double *next, int *path){
+		//the first jumpWidth states have a shorter band, do them one by one
+		int j=0;
+		for(; j<jumpWidth && j<stateNum; j++){
+			ViterbiKernel::calculateState<withPath>(previous, bandTran, fromFirst, stateNum, jumpWidth, distribution, next, path, j);
+		}
+		const __m128d logZero = _mm_set1_pd(LOGZERO);
+		const __m128d lastState = _mm_set1_pd(stateNum-1);
+		for(; j+2<=stateNum; j+=2){
+			__m128d state = _mm_set_pd(j+1, j);
+			__m128d best = _mm_add_pd(_mm_loadu_pd(previous+j), _mm_loadu_pd(bandTran+j));
+			__m128d bestPath = state;
+			for(int d=1; d<=jumpWidth; d++){
+				__m128d temp = _mm_add_pd(_mm_loadu_pd(previous+j-d), _mm_loadu_pd(bandTran+d*stateNum+j));
+				__m128d better = _mm_cmpgt_pd(temp, best);
+				best = _mm_blendv_pd(best, temp, better);
+				if(withPath){
+					bestPath = _mm_blendv_pd(bestPath, _mm_sub_pd(state, _mm_set1_pd(d)), better);
+				}
+			}
+			if(fromFirst!=NULL){//at j==jumpWidth it is d=j again, and a tie changes nothing
+				__m128d temp = _mm_add_pd(_mm_set1_pd(previous[0]), _mm_loadu_pd(fromFirst+j));
+				__m128d better = _mm_cmpgt_pd(temp, best);
+				best = _mm_blendv_pd(best, temp, better);
+				if(withPath){
+					bestPath = _mm_blendv_pd(bestPath, _mm_setzero_pd(), better);
+				}
+			}
+			_mm_storeu_pd(next+j, _mm_add_pd(best, _mm_loadu_pd(distribution+j)));
+			if(withPath){
+				bestPath = _mm_blendv_pd(bestPath, lastState, _mm_cmpeq_pd(best, logZero));
+				_mm_storel_epi64((__m128i *)(path+j), _mm_cvtpd_epi32(bestPath));
+			}
+		}
+		for(; j<stateNum; j++){
+			ViterbiKernel::calculateState<withPath>(previous, bandTran, fromFirst, stateNum, jumpWidth, distribution, next, path, j);
+		}
+	}
+
+	template<bool withPath> RH_TARGET("avx2")
+	void ViterbiKernel::avx2Column(const double *previous, const double *bandTran, const double *fromFirst, int stateNum, int jumpWidth, const double *distribution, double *next, int *path){
+		int j=0;
+		for(; j<jumpWidth && j<stateNum; j++){
+			ViterbiKernel::calculateState<withPath>(previous, bandTran, fromFirst, stateNum, jumpWidth, distribution, next, path, j);
+		}
+		const __m256d logZero = _mm256_set1_pd(LOGZERO);
+		const __m256d lastState = _mm256_set1_pd(stateNum-1);
+		for(; j+4<=stateNum; j+=4){
+			__m256d state = _mm256_set_pd(j+3, j+2, j+1, j);
+			__m256d best = _mm256_add_pd(_mm256_loadu_pd(previous+j), _mm256_loadu_pd(bandTran+j));
+			__m256d bestPath = state;
+			for(int d=1; d<=jumpWidth; d++){
+				__m256d temp = _mm256_add_pd(_mm256_loadu_pd(previous+j-d), _mm256_loadu_pd(bandTran+d*stateNum+j));
+				__m256d better = _mm256_cmp_pd(temp, best, _CMP_GT_OQ);
+				best = _mm256_blendv_pd(best, temp, better);
+				if(withPath){
+					bestPath = _mm256_blendv_pd(bestPath, _mm256_sub_pd(state, _mm256_set1_pd(d)), better);
+				}
+			}
+			if(fromFirst!=NULL){
+				__m256d temp = _mm256_add_pd(_mm256_set1_pd(previous[0]), _mm256_loadu_pd(fromFirst+j));
+				__m256d better = _mm256_cmp_pd(temp, best, _CMP_GT_OQ);
+				best = _mm256_blendv_pd(best, temp, better);
+				if(withPath){
+					bestPath = _mm256_blendv_pd(bestPath, _mm256_setzero_pd(), better);
+				}
+			}
+			_mm256_storeu_pd(next+j, _mm256_add_pd(best, _mm256_loadu_pd(distribution+j)));
+			if(withPath){
+				bestPath = _mm256_blendv_pd(bestPath, lastState, _mm256_cmp_pd(best, logZero, _CMP_EQ_OQ));
+				_mm_storeu_si128((__m128i *)(path+j), _mm256_cvtpd_epi32(bestPath));
+			}
+		}
+		for(; j<stateNum; j++){
+			ViterbiKernel::calculateState<withPath>(previous, bandTran, fromFirst, stateNum, jumpWidth, distribution, next, path, j);
+		}
+	}
+
+	template<bool withPath> RH_TARGET("avx512f")
+	void ViterbiKernel::avx512Column(const double *previous, const double *bandTran, const double *fromFirst, int stateNum, int jumpWidth, const double *distribution, double *next, int *path){
+		int j=0;
+		for(; j<jumpWidth && j<stateNum; j++){
+			ViterbiKernel::calculateState<withPath>(previous, bandTran, fromFirst, stateNum, jumpWidth, distribution, next, path, j);
+		}
+		const __m512d logZero = _mm512_set1_pd(LOGZERO);
+		const __m512d lastState = _mm512_set1_pd(stateNum-1);
+		for(; j+8<=stateNum; j+=8){
+			__m512d state = _mm512_set_pd(j+7, j+6, j+5, j+4, j+3, j+2, j+1, j);
+			__m512d best = _mm512_add_pd(_mm512_loadu_pd(previous+j), _mm512_loadu_pd(bandTran+j));
+			__m512d bestPath = state;
+			for(int d=1; d<=jumpWidth; d++){
+				__m512d temp = _mm512_add_pd(_mm512_loadu_pd(previous+j-d), _mm512_loadu_pd(bandTran+d*stateNum+j));
+				__mmask8 better = _mm512_cmp_pd_mask(temp, best, _CMP_GT_OQ);
+				best = _mm512_mask_blend_pd(better, best, temp);
+				if(withPath){
+					bestPath = _mm512_mask_blend_pd(better, bestPath, _mm512_sub_pd(state, _mm512_set1_pd(d)));
+				}
+			}
+			if(fromFirst!=NULL){
+				__m512d temp = _mm512_add_pd(_mm512_set1_pd(previous[0]), _mm512_loadu_pd(fromFirst+j));
+				__mmask8 better = _mm512_cmp_pd_mask(temp, best, _CMP_GT_OQ);
+				best = _mm512_mask_blend_pd(better, best, temp);
+				if(withPath){
+					bestPath = _mm512_mask_blend_pd(better, bestPath, _mm512_setzero_pd());
+				}
+			}
+			_mm512_storeu_pd(next+j, _mm512_add_pd(best, _mm512_loadu_pd(distribution+j)));
+			if(withPath){
+				bestPath = _mm512_mask_blend_pd(_mm512_cmp_pd_mask(best, logZero, _CMP_EQ_OQ), bestPath, lastState);
+				_mm256_storeu_si256((__m256i *)(path+j), _mm512_cvtpd_epi32(bestPath));
+			}
+		}
+		for(; j<stateNum; j++){
+			ViterbiKernel::calculateState<withPath>(previous, bandTran, fromFirst, stateNum, jumpWidth, distribution, next, path, j);
+		}
+	}
+
+	RH_TARGET("sse4.2")
+	void ViterbiKernel::sse42(const double *previous, const double *bandTran, const double *fromFirst, int stateNum, int jumpWidth, const double *distribution, double *next, int *path){
+		ViterbiKernel::sse42Column<true>(previous, bandTran, fromFirst, stateNum, jumpWidth, distribution, next, path);
+	}
+
+	RH_TARGET("sse4.2")
+	void ViterbiKernel::sse42Score(const double *previous, const double *bandTran, const double *fromFirst, int stateNum, int jumpWidth, const double *distribution, double *next){
+		ViterbiKernel::sse42Column<false>(previous, bandTran, fromFirst, stateNum, jumpWidth, distribution, next, NULL);
+	}
+
+	RH_TARGET("avx2")
+	void ViterbiKernel::avx2(const double *previous, const double *bandTran, const double *fromFirst, int stateNum, int jumpWidth, const double *distribution, double *next, int *path){
+		ViterbiKernel::avx2Column<true>(previous, bandTran, fromFirst, stateNum, jumpWidth, distribution, next, path);
+	}
+
+	RH_TARGET("avx2")
+	void ViterbiKernel::avx2Score(const double *previous, const double *bandTran, const double *fromFirst, int stateNum, int jumpWidth, const double *distribution, double *next){
+		ViterbiKernel::avx2Column<false>(previous, bandTran, fromFirst, stateNum, jumpWidth, distribution, next, NULL);
+	}
+
+	RH_TARGET("avx512f")
+	void ViterbiKernel::avx512(const double *previous, const double *bandTran, const double *fromFirst, int stateNum, int jumpWidth, const double *distribution, double *next, int *path){
+		ViterbiKernel::avx512Column<true>(previous, bandTran, fromFirst, stateNum, jumpWidth, distribution, next, path);
+	}
+
+	RH_TARGET("avx512f")
+	void ViterbiKernel::avx512Score(const double *previous, const double *bandTran, const double *fromFirst, int stateNum, int jumpWidth, const double *distribution, double *next){
+		ViterbiKernel::avx512Column<false>(previous, bandTran, fromFirst, stateNum, jumpWidth, distribution, next, NULL);
+	}
+
+#endif
+
+	bool ViterbiKernel::cpuSupports(string isa){
+#if defined(RH_X86) && defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		int maxLeaf = info[0];
+		__cpuid(info, 1);
+		bool sse42 = (info[2] & (1<<20))!=0;
+		bool osSavesYmm = (info[2] & (1<<27))!=0 && (_xgetbv(0) & 0x6)==0x6;
+		bool osSavesZmm = osSavesYmm && (_xgetbv(0) & 0xe6)==0xe6;
+		bool avx2 = false;
+		bool avx512 = false;
+		if(maxLeaf>=7){
+			__cpuidex(info, 7, 0);
+			avx2 = osSavesYmm && (info[1] & (1<<5))!=0;
+			avx512 = osSavesZmm && (info[1] & (1<<16))!=0;
+		}
+		if(isa.compare("sse4.2")==0) return sse42;
+		if(isa.compare("avx2")==0) return avx2;
+		if(isa.compare("avx512f")==0) return avx512;
+		return false;
+#elif defined(RH_X86) && defined(__GNUC__)
+		__builtin_cpu_init();
+		if(isa.compare("sse4.2")==0) return __builtin_cpu_supports("sse4.2");
+		if(isa.compare("avx2")==0) return __builtin_cpu_supports("avx2");
+		if(isa.compare("avx512f")==0) return __builtin_cpu_supports("avx512f");
+		return false;
+#else
+		return false;
+#endif
+	}
+
+	//RH_ISA=scalar|sse4.2|avx2|avx512f caps the kernel, e.g. to compare them on one box
+	//the choices are static members set before main, see the end of the file, so the decoder
+	//threads only ever read them; a function-local static isn't safe to start from several
+	//threads with cl before VS2015
+	string ViterbiKernel::isa(){
+		return chosenIsa;
+	}
+
+	bool ViterbiKernel::hasAvx2(){
+		return chosenAvx2;
+	}
+
+	bool ViterbiKernel::hasAvx512(){
+		return chosenAvx512;
+	}
+
+	ColumnKernel ViterbiKernel::kernel(){
+		return chosenKernel;
+	}
+
+	ScoreKernel ViterbiKernel::scoreKernel(){
+		return chosenScoreKernel;
+	}
+
+	string ViterbiKernel::chooseIsa(){
+		const char *cap = getenv("RH_ISA");
+		string wanted = cap==NULL ? "avx512f" : cap;
+		const char *order[] = {"avx512f", "avx2", "sse4.2"};
+		bool allowed = false;
+		for(int i=0; i<3; i++){
+			if(wanted.compare(order[i])==0) allowed = true;
+			if(allowed && ViterbiKernel::cpuSupports(order[i])){
+				return order[i];
+			}
+		}
+		return "scalar";
+	}
+
+	ColumnKernel ViterbiKernel::chooseKernel(){
+		string isa = ViterbiKernel::isa();
+#ifdef RH_X86
+		if(isa.compare("avx512f")==0) return ViterbiKernel::avx512;
+		if(isa.compare("avx2")==0) return ViterbiKernel::avx2;
+		if(isa.compare("sse4.2")==0) return ViterbiKernel::sse42;
+#endif
+		return ViterbiKernel::scalar;
+	}
+
+	ScoreKernel ViterbiKernel::chooseScoreKernel(){
+		string isa = ViterbiKernel::isa();
+#ifdef RH_X86
+		if(isa.compare("avx512f")==0) return ViterbiKernel::avx512Score;
+		if(isa.compare("avx2")==0) return ViterbiKernel::avx2Score;
+		if(isa.compare("sse4.2")==0) return ViterbiKernel::sse42Score;
+#endif
+		return ViterbiKernel::scalarScore;
+	}
+
+	//in this order, the kernels are picked for the isa
+	const string ViterbiKernel::chosenIsa = ViterbiKernel::chooseIsa();
+	const bool ViterbiKernel::chosenAvx2 = ViterbiKernel::chosenIsa.compare("avx2")==0 || ViterbiKernel::chosenIsa.compare("avx512f")==0;
+	const bool ViterbiKernel::chosenAvx512 = ViterbiKernel::chosenIsa.compare("avx512f")==0;
+	const ColumnKernel ViterbiKernel::chosenKernel = ViterbiKernel::chooseKernel();
+	const ScoreKernel ViterbiKernel::chosenScoreKernel = ViterbiKernel::chooseScoreKernel();
+}
+
+#endif //__ViterbiKernel__
@@ -0,0 +1,422 @@
+#include <iostream>
+#include <string>
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/path.hpp>
+#include "Model.h"
+#include "ModelBank.h"
+#include "DecoderWorkspace.h"
+#include "Viterbi.h"
+#include "ReferenceViterbi.h"
+#include "ParallelViterbi.h"
+#include "BatchViterbi.h"
+#include "BeamViterbi.h"
+#include "ReducedViterbi.h"
+#include "CompiledModels.h"
+#include "RunLength.h"
+#include "RunViterbi.h"
+#include "ViterbiResult.h"
+#include <vector>
+
+namespace fs = boost::filesystem;
+namespace rh = redhat;
+using namespace std;
+
+//one way of decoding and how it did against the reference
+class Engine{
+	public:
+		string name;
+		bool hasPath;//score-only engines have no path to check
+		bool mayTie;//adds up in another order, so on a rounding tie it may pick another path of the same score
+		double relative;//a score may be this far from the reference, relative to it
+		double perColumn;//and this much more for every observation, for the engines that round every step
+		int cases;
+		int scoreDiffers;
+		int pathDiffers;//paths that aren't the reference's, and for mayTie don't score the same either
+		int ties;//other paths with the same score as the reference's, for mayTie
+		int threw;
+		double time;
+		string example;//the first case that failed
+};
+
+//a set of models and the observations to decode with each of them
+class TestSet{
+	public:
+		string name;
+		vector<rh::Model> models;
+		vector<string> characters;//what each model is, to find it among the compiled models
+		vector< vector<int> > observations;
+};
+
+enum{REFERENCE, DECODE, CHECKPOINTED, PARALLEL, BATCH, PROBABILITY, BANK, FLOAT, INT16, COMPILED, BEAM, RUN, ENGINES};
+
+void addEngine(vector<Engine> &engines, string name, bool hasPath, bool mayTie, double relative, double perColumn);
+void loadModels(string directory, TestSet &set);
+void loadObservations(string directory, TestSet &set);
+rh::Model randomModel(int kind);
+vector<int> randomObservation(int strokes);
+vector<rh::ViterbiResult> decodeAll(int e, const rh::Model &model, string character, const vector< vector<int> > &observations, rh::CompiledModels &compiledModels, vector<bool> &threw, double &time);
+void check(Engine &engine, const rh::Model &model, const vector<int> &observation, const rh::ViterbiResult &reference, bool referenceThrew, const rh::ViterbiResult &result, bool threw);
+
+const int RANDOM_MODELS = 60;
+const int RANDOM_OBSERVATIONS = 40;//for each random model
+
+/* Runs every decoder on the optimised models against the training and recognition samples, on
+ * random models and observations, and on the odd observations quantilise can write (a stroke of
+ * one point, strokes shorter than STATENO, more strokes than the model, an empty file), and
+ * checks each one against ReferenceViterbi: the score to the engine's tolerance and the path
+ * exactly. The engines that add up in another order than the reference, ParallelViterbi and
+ * BatchViterbi with RH_PARALLEL=on and more than one thread, may instead give another path with
+ * the same score. RunViterbi must also give bitwise the score of Viterbi::Calculate_probability.
+ * Reports the failures and how much faster than the reference every engine is, and returns 1 if
+ * any engine failed or the optimised models or the samples weren't there.
+ */
+int main(){
+	vector<Engine> engines;
+	addEngine(engines, "reference", true, false, 0, 0);
+	addEngine(engines, "decode", true, false, 1e-12, 0);
+	addEngine(engines, "checkpointed", true, false, 1e-12, 0);
+	addEngine(engines, "parallel", true, true, 1e-12, 0);
+	addEngine(engines, "batch", true, rh::ParallelViterbi::threads()>1 && rh::ParallelViterbi::use(), 1e-12, 0);//with RH_PARALLEL=on long observations go to ParallelViterbi
+	addEngine(engines, "probability", false, false, 1e-12, 0);
+	addEngine(engines, "bank", false, false, 1e-12, 0);
+	addEngine(engines, "float", false, false, 1e-5, 0);
+	addEngine(engines, "int16", false, false, 0, 2.0/rh::ReducedModel::SCALE);//two rounded table entries a step
+	addEngine(engines, "compiled", false, false, 1e-12, 0);
+	addEngine(engines, "beam", false, false, 1e-12, 0);//with nothing to beat and no beam, so it must be exact
+	addEngine(engines, "run", false, false, 1e-12, 0);//and bitwise the same as probability
+
+	string libraryPath = "./data/trainingData/compiledModels/"+rh::CompiledModels::libraryName();
+	rh::CompiledModels compiledModels;
+	if(!compiledModels.load(libraryPath)){
+		cout<<"no compiled models, that engine falls back to the generic one"<<endl;
+	}
+
+	vector<TestSet> sets(4);
+	sets[0].name = "training";
+	loadModels("./data/trainingData/localOptimisedData/", sets[0]);
+	loadObservations("./data/trainingData/localInitialData/", sets[0]);
+	sets[1].name = "recognition";
+	sets[1].models = sets[0].models;
+	sets[1].characters = sets[0].characters;
+	loadObservations("./data/recognitionData/localFeatureData/", sets[1]);
+
+	srand(2007);//the same random cases every run
+	sets[2].name = "random";
+	for(int m=0; m<RANDOM_MODELS; m++){
+		sets[2].models.push_back(randomModel(m%3));
+		sets[2].characters.push_back("random");
+	}
+	for(int o=0; o<RANDOM_OBSERVATIONS; o++){
+		sets[2].observations.push_back(randomObservation(1+rand()%8));
+	}
+
+	sets[3].name = "edge";
+	sets[3].models = sets[0].models;
+	sets[3].characters = sets[0].characters;
+	for(int m=0; m<6; m++){
+		sets[3].models.push_back(sets[2].models[m]);
+		sets[3].characters.push_back("random");
+	}
+	sets[3].observations.push_back(vector<int>());//an empty file
+	sets[3].observations.push_back(vector<int>(1, 16));//one point
+	sets[3].observations.push_back(vector<int>(1, 3));//one point without a marker
+	int onePoints[] = {16, 17, 18, 19};//strokes of a single point: the start of stroke only
+	sets[3].observations.push_back(vector<int>(onePoints, onePoints+4));
+	int shortStrokes[] = {16, -16, 20, 2, -13, 19, 3, 3, -13};//fewer points than STATENO
+	sets[3].observations.push_back(vector<int>(shortStrokes, shortStrokes+9));
+	int noMarkers[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+	sets[3].observations.push_back(vector<int>(noMarkers, noMarkers+16));
+	sets[3].observations.push_back(randomObservation(40));//more strokes than any model has
+	int endOnly[] = {16, 0, -16, -16, -16};//ends of stroke one after the other
+	sets[3].observations.push_back(vector<int>(endOnly, endOnly+5));
+
+	for(int s=0; s<sets.size(); s++){
+		cout<<sets[s].name<<": "<<sets[s].models.size()<<" models, "<<sets[s].observations.size()<<" observations"<<endl;
+		for(int m=0; m<sets[s].models.size(); m++){
+			const rh::Model &model = sets[s].models[m];
+			vector< vector<rh::ViterbiResult> > results(ENGINES);
+			vector< vector<bool> > threw(ENGINES);
+			for(int e=0; e<ENGINES; e++){
+				results[e] = decodeAll(e, model, sets[s].characters[m], sets[s].observations, compiledModels, threw[e], engines[e].time);
+			}
+			for(int o=0; o<sets[s].observations.size(); o++){
+				for(int e=0; e<ENGINES; e++){
+					int differed = engines[e].scoreDiffers;
+					check(engines[e], model, sets[s].observations[o], results[REFERENCE][o], threw[REFERENCE][o], results[e][o], threw[e][o]);
+					if(e==RUN && engines[e].scoreDiffers==differed && !threw[e][o] && !threw[PROBABILITY][o] && results[e][o].probability!=results[PROBABILITY][o].probability){
+						engines[e].scoreDiffers++;
+					}
+					if(engines[e].example.size()==0 && (engines[e].scoreDiffers>0 || engines[e].pathDiffers>0)){
+						char text[100];
+						sprintf(text, "%s set, model %d, observation %d", sets[s].name.c_str(), m, o);
+						engines[e].example = text;
+					}
+				}
+			}
+		}
+	}
+
+	bool failed = false;
+	cout<<endl<<"engine\t\tcases\tscore\tpath\tties\tthrew\ttime\tspeedup"<<endl;
+	for(int e=0; e<ENGINES; e++){
+		Engine &engine = engines[e];
+		cout<<engine.name<<(engine.name.size()<8 ? "\t\t" : "\t")<<engine.cases<<"\t"<<engine.scoreDiffers<<"\t";
+		if(engine.hasPath){
+			cout<<engine.pathDiffers<<"\t"<<engine.ties;
+		}else{
+			cout<<"-\t-";
+		}
+		cout<<"\t"<<engine.threw<<"\t"<<engine.time<<"s\t";
+		cout<<(engine.time>0 ? engines[REFERENCE].time/engine.time : 0)<<"x"<<endl;
+		failed = failed || engine.scoreDiffers>0 || engine.pathDiffers>0;
+	}
+	cout<<"(score: scores outside the tolerance, path: paths that aren't the reference's, or for parallel and"<<endl;
+	cout<<" batch with RH_PARALLEL=on and threads score differently from it, ties: other paths with the reference's score,"<<endl;
+	cout<<" threw: cases that threw like the reference does for an empty file)"<<endl;
+	for(int e=0; e<ENGINES; e++){
+		if(engines[e].example.size()>0){
+			cout<<engines[e].name<<" first fails for "<<engines[e].example<<endl;
+		}
+	}
+	//without the optimised models and the samples only the random cases were checked
+	if(sets[0].models.size()==0 || sets[0].observations.size()==0 || sets[1].observations.size()==0){
+		cout<<"no optimised models, training or recognition samples, run quantilise, optimise and quantiliseReco first"<<endl;
+		failed = true;
+	}
+	return failed ? 1 : 0;
+}
+
+void addEngine(vector<Engine> &engines, string name, bool hasPath, bool mayTie, double relative, double perColumn){
+	Engine engine;
+	engine.name = name;
+	engine.hasPath = hasPath;
+	engine.mayTie = mayTie;
+	engine.relative = relative;
+	engine.perColumn = perColumn;
+	engine.cases = 0;
+	engine.scoreDiffers = 0;
+	engine.pathDiffers = 0;
+	engine.ties = 0;
+	engine.threw = 0;
+	engine.time = 0;
+	engines.push_back(engine);
+}
+
+void loadModels(string directory, TestSet &set){
+	fs::path models_path(directory);
+	if(!fs::exists(models_path)){
+		cout<<"Cannot read the direcotry"<<endl;
+		return;
+	}
+	fs::directory_iterator end_itr;
+	for(fs::directory_iterator itr(models_path); itr!=end_itr; ++itr){	//each directory represent one character
+		if(fs::is_directory(*itr)){
+			rh::Model model;
+			model.load(directory+itr->leaf()+"_dis.txt", directory+itr->leaf()+"_tran.txt");
+			set.models.push_back(model);
+			set.characters.push_back(itr->leaf());
+		}
+	}
+}
+
+//every sample in the directories of a data directory
+void loadObservations(string directory, TestSet &set){
+	fs::path data_path(directory);
+	if(!fs::exists(data_path)){
+		cout<<"Cannot read the direcotry"<<endl;
+		return;
+	}
+	fs::directory_iterator end_itr;
+	for(fs::directory_iterator itr(data_path); itr!=end_itr; ++itr){
+		if(!fs::is_directory(*itr)){
+			continue;
+		}
+		for(fs::directory_iterator sub_itr(*itr); sub_itr!=end_itr; ++sub_itr){
+			if(!fs::is_directory(*sub_itr)){
+				set.observations.push_back(rh::Viterbi::readObservation(directory+itr->leaf()+"/"+sub_itr->leaf()));
+			}
+		}
+	}
+}
+
+//a probability that is 0 about one time in five, in eighths so that paths tie now and then
+double randomProbability(){
+	return rand()%5==0 ? 0 : (1+rand()%8)/8.0;
+}
+
+/* kind 0: strokes of STATENO states as quantilise writes them, which have the stroke shape,
+ * kind 1: a left-to-right model with a random band, kind 2: a model that can go back.
+ */
+rh::Model randomModel(int kind){
+	int stateNum = kind==0 ? rh::STATENO*(1+rand()%6) : 2+rand()%30;
+	int band = 1+rand()%stateNum;
+	vector<double> disProb(stateNum*16);
+	for(int i=0; i<disProb.size(); i++){
+		disProb[i] = randomProbability();
+	}
+	vector< vector<double> > tranProb(stateNum, vector<double>(stateNum, 0));
+	for(int k=0; k<stateNum; k++){
+		for(int j=0; j<stateNum; j++){
+			bool allowed;
+			if(kind==0){
+				int d = j-k;
+				allowed = k==0 || (d>=0 && d<=rh::JUMPNO && d<=j%rh::STATENO) || (d==1 && j%rh::STATENO==0);
+			}else if(kind==1){
+				allowed = j>=k && j-k<band;
+			}else{
+				allowed = true;
+			}
+			if(allowed){
+				tranProb[k][j] = randomProbability();
+			}
+		}
+		tranProb[k][k<stateNum-1 && kind!=2 ? k+1 : k] = 0.5;//keep the model connected
+	}
+	rh::Model model;
+	model.set(disProb, tranProb);
+	return model;
+}
+
+//strokes of 1 to 10 points: the start of stroke, the points in between and the end of stroke
+vector<int> randomObservation(int strokes){
+	vector<int> observation;
+	for(int s=0; s<strokes; s++){
+		int points = 1+rand()%10;
+		for(int p=0; p<points; p++){
+			int direction = rand()%16;
+			if(p==0){
+				observation.push_back(direction+16);
+			}else if(p==points-1){
+				observation.push_back(direction-16);
+			}else{
+				observation.push_back(direction);
+			}
+		}
+	}
+	return observation;
+}
+
+//every observation with one model, and the time it took
+vector<rh::ViterbiResult> decodeAll(int e, const rh::Model &model, string character, const vector< vector<int> > &observations, rh::CompiledModels &compiledModels, vector<bool> &threw, double &time){
+	vector<rh::ViterbiResult> results(observations.size());
+	threw.assign(observations.size(), false);
+	rh::DecoderWorkspace &workspace = rh::DecoderWorkspace::local();
+	rh::ModelBank bank;
+	rh::ReducedModel reducedModel;
+	rh::Beam beam(0);
+	if(e==BANK||e==COMPILED){
+		bank.add(character, model);
+		bank.pack();
+	}
+	if(e==FLOAT||e==INT16){
+		reducedModel.set(model);
+	}
+
+	clock_t start = clock();
+	if(e==BATCH){
+		try{
+			rh::BatchViterbi::decode(model, observations, results);
+		}catch(...){//one observation spoils the batch, find which on their own
+			for(int o=0; o<observations.size(); o++){
+				vector<rh::ViterbiResult> single(1);
+				try{
+					rh::BatchViterbi::decode(model, vector< vector<int> >(1, observations[o]), single);
+					results[o] = single[0];
+				}catch(...){
+					threw[o] = true;
+				}
+			}
+		}
+	}else{
+		for(int o=0; o<observations.size(); o++){
+			const vector<int> &observation = observations[o];
+			rh::ViterbiResult &result = results[o];
+			try{
+				switch(e){
+					case REFERENCE:
+						result = rh::ReferenceViterbi::decode(model, observation);
+						break;
+					case DECODE:
+						result.probability = rh::Viterbi::decode(model, observation, workspace);
+						result.path = workspace.path;
+						break;
+					case CHECKPOINTED:
+						result.probability = rh::Viterbi::decodeCheckpointed(model, observation, workspace);
+						result.path = workspace.path;
+						break;
+					case PARALLEL:
+						result.probability = rh::ParallelViterbi::decode(model, observation, workspace, 3);
+						result.path = workspace.path;
+						break;
+					case PROBABILITY:
+						result.probability = rh::Viterbi::Calculate_probability(model, observation);
+						break;
+					case BANK:
+						result.probability = bank.score(const_cast<vector<int> &>(observation))[0].probability;
+						break;
+					case FLOAT:
+						result.probability = rh::ReducedViterbi::Calculate_probability_float(reducedModel, observation);
+						break;
+					case INT16:
+						result.probability = rh::ReducedViterbi::Calculate_probability_fixed(reducedModel, observation);
+						break;
+					case COMPILED:
+						result.probability = compiledModels.score(bank, const_cast<vector<int> &>(observation))[0].probability;
+						break;
+					case BEAM:
+						result.probability = rh::BeamViterbi::Calculate_probability(model, observation, rh::LOGZERO, beam);
+						break;
+					case RUN:
+						result.probability = rh::RunViterbi::Calculate_probability(model, rh::RunLength::encode(observation));
+						break;
+				}
+			}catch(...){
+				threw[o] = true;
+			}
+		}
+	}
+	time += (double)(clock()-start)/CLOCKS_PER_SEC;
+	return results;
+}
+
+void check(Engine &engine, const rh::Model &model, const vector<int> &observation, const rh::ViterbiResult &reference, bool referenceThrew, const rh::ViterbiResult &result, bool threw){
+	engine.cases++;
+	if(threw){
+		engine.threw++;
+	}
+	if(referenceThrew || threw){//an empty observation: nothing to decode, but no score either
+		if(!referenceThrew || (!threw && result.probability!=rh::LOGZERO)){
+			engine.scoreDiffers++;
+		}
+		return;
+	}
+	double tolerance = engine.relative*fabs(reference.probability)+engine.perColumn*observation.size();
+	bool sameScore;
+	if(reference.probability==rh::LOGZERO || result.probability==rh::LOGZERO){
+		sameScore = reference.probability==result.probability;
+	}else{
+		sameScore = fabs(result.probability-reference.probability)<=tolerance;
+	}
+	if(!sameScore){
+		engine.scoreDiffers++;
+	}
+	if(!engine.hasPath || result.path==reference.path){
+		return;
+	}
+	//a different path is only fine from an engine that reassociates, and with the same score
+	if(!engine.mayTie){
+		engine.pathDiffers++;
+		return;
+	}
+	double score = rh::ReferenceViterbi::pathScore(model, observation, result.path);
+	if(reference.probability!=rh::LOGZERO && score!=rh::LOGZERO && fabs(score-reference.probability)<=1e-12*fabs(reference.probability)){
+		engine.ties++;
+	}else{
+		engine.pathDiffers++;
+	}
+}
@@ -0,0 +1,176 @@
+#include <iostream>
+#include <string>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/path.hpp>
+#include "Model.h"
+#include "ModelBank.h"
+#include "Prefilter.h"
+#include "ShortlistIndex.h"
+#include "Viterbi.h"
+#include <vector>
+
+namespace fs = boost::filesystem;
+namespace rh = redhat;
+using namespace std;
+
+//a copy of the model with every emission probability scaled by a random factor up to e to the noise either way
+rh::Model perturb(const rh::Model &model, double noise);
+//the bank of the models, copies times over with every copy but the first perturbed
+void fill(rh::ModelBank &bank, const vector<rh::Model> &models, const vector<string> &characters, int copies);
+
+const int REPEAT = 20;//every sample is timed this many times, one is too short for clock()
+const int SIZE = 10;//the shortlist size the banks are compared at
+
+/* Compares the shortlist of the index with the shortlist of the prefilter's scan of every model,
+ * first on the trained models for several shortlist sizes M, then for banks of more and more
+ * models made from noisy copies of them at M=SIZE. recall is the share of the scan's shortlist
+ * the index keeps too, best kept how often it keeps the scan's best model, compared and reranked
+ * the embeddings the index looks at and the models it scores a sample. The scan's time grows with
+ * the bank, the index's with those. Run it where recognise runs.
+ */
+int main(){
+	fs::path optimisedData_path("./data/trainingData/localOptimisedData/");
+	fs::path recognitionData_path("./data/recognitionData/localFeatureData/");
+
+	if(!fs::exists(optimisedData_path)||!fs::exists(recognitionData_path)){
+		cout<<"Cannot read the direcotry"<<endl;
+		return 1;
+	}
+
+	vector<rh::Model> models;
+	vector<string> characters;
+	fs::directory_iterator end_itr;
+	for(fs::directory_iterator itr(optimisedData_path); itr!=end_itr; ++itr){	//each directory represent one character
+		if(fs::is_directory(*itr)){
+			rh::Model model;
+			model.load("./data/trainingData/localOptimisedData/"+itr->leaf()+"_dis.txt", "./data/trainingData/localOptimisedData/"+itr->leaf()+"_tran.txt");
+			models.push_back(model);
+			characters.push_back(itr->leaf());
+		}
+	}
+
+	vector< vector<int> > observations;
+	for(fs::directory_iterator itr(recognitionData_path); itr!=end_itr; ++itr){
+		if(!fs::is_directory(*itr)){
+			continue;
+		}
+		for(fs::directory_iterator sub_itr(*itr); sub_itr!=end_itr; ++sub_itr){
+			if(fs::is_directory(*sub_itr)){
+				continue;
+			}
+			vector<int> observation = rh::Viterbi::readObservation("./data/recognitionData/localFeatureData/"+itr->leaf()+"/"+sub_itr->leaf());
+			if(observation.size()>0){
+				observations.push_back(observation);
+			}
+		}
+	}
+	int samples = observations.size();
+	cout<<samples<<" samples against "<<models.size()<<" models"<<endl;
+	if(samples==0 || models.size()==0){
+		return 0;
+	}
+
+	int tolerance = rh::ModelBank::strokeTolerance();
+	int copies[] = {1, 8, 64, 256};
+	int sizes[] = {1, 3, 5, 10};
+	cout<<"models\tM\trecall\tbest kept\tcompared\treranked\tscan ms\tindex ms"<<endl;
+	for(int c=0; c<4; c++){
+		rh::ModelBank modelBank;
+		fill(modelBank, models, characters, copies[c]);
+		rh::ShortlistIndex shortlistIndex;
+		shortlistIndex.build(modelBank);
+		for(int s=0; s<4; s++){
+			int size = sizes[s];
+			if(c>0 && size!=SIZE){
+				continue;
+			}
+			double recall = 0;
+			int bestKept = 0;
+			double scanTime = 0;
+			double indexTime = 0;
+			shortlistIndex.visited = 0;
+			shortlistIndex.reranked = 0;
+			for(int o=0; o<samples; o++){
+				vector<bool> scan;
+				vector<bool> found;
+				clock_t start = clock();
+				for(int r=0; r<REPEAT; r++){
+					scan = modelBank.prefilter.shortlist(observations[o], modelBank.candidates(observations[o], tolerance), size);
+				}
+				scanTime += (double)(clock()-start)/CLOCKS_PER_SEC/REPEAT;
+				start = clock();
+				for(int r=0; r<REPEAT; r++){
+					found = shortlistIndex.shortlist(modelBank, observations[o], tolerance, size);
+				}
+				indexTime += (double)(clock()-start)/CLOCKS_PER_SEC/REPEAT;
+
+				//the scan's best is the one with the highest score of its shortlist, the first on a tie
+				double histogram[rh::Prefilter::BINS];
+				rh::Prefilter::histogram(observations[o], histogram);
+				int listed = 0;
+				int kept = 0;
+				int best = -1;
+				for(int m=0; m<scan.size(); m++){
+					if(!scan[m]){
+						continue;
+					}
+					listed++;
+					if(found[m]) kept++;
+					if(best<0 || modelBank.prefilter.score(m, histogram)>modelBank.prefilter.score(best, histogram)){
+						best = m;
+					}
+				}
+				recall += listed>0 ? (double)kept/listed : 1;
+				if(best<0 || found[best]) bestKept++;
+			}
+			cout<<modelBank.models.size()<<"\t"<<size<<"\t"<<100*recall/samples<<"%\t"<<100.0*bestKept/samples<<"%\t\t";
+			cout<<(double)shortlistIndex.visited/REPEAT/samples<<"\t\t"<<(double)shortlistIndex.reranked/REPEAT/samples<<"\t\t"<<1000*scanTime/samples<<"\t"<<1000*indexTime/samples<<endl;
+		}
+	}
+
+	return 0;
+}
+
+rh::Model perturb(const rh::Model &model, double noise){
+	vector<double> disProb(model.stateNum*16);
+	for(int j=0; j<model.stateNum; j++){
+		double total = 0;
+		for(int k=0; k<16; k++){
+			disProb[j*16+k] = exp(model.distribution(j, k))*exp(noise*(2.0*rand()/RAND_MAX-1));
+			total += disProb[j*16+k];
+		}
+		for(int k=0; k<16 && total>0; k++){
+			disProb[j*16+k] /= total;
+		}
+	}
+	vector< vector<double> > tranProb(model.stateNum, vector<double>(model.stateNum));
+	for(int k=0; k<model.stateNum; k++){
+		for(int j=0; j<model.stateNum; j++){
+			tranProb[k][j] = exp(model.transition(k, j));
+		}
+	}
+	rh::Model copy;
+	copy.set(disProb, tranProb);
+	return copy;
+}
+
+void fill(rh::ModelBank &bank, const vector<rh::Model> &models, const vector<string> &characters, int copies){
+	srand(2007);
+	for(int copy=0; copy<copies; copy++){
+		for(int m=0; m<models.size(); m++){
+			if(copy==0){
+				bank.add(characters[m], models[m]);
+			}else{
+				char name[16];
+				sprintf(name, "~%d", copy);
+				bank.add(characters[m]+name, perturb(models[m], 2));
+			}
+		}
+	}
+	bank.pack();
+}
@@ -0,0 +1,104 @@
+#include <iostream>
+#include <string>
+#include <math.h>
+#include <time.h>
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/path.hpp>
+#include "Model.h"
+#include "ReducedViterbi.h"
+#include "Viterbi.h"
+#include <vector>
+
+namespace fs = boost::filesystem;
+namespace rh = redhat;
+using namespace std;
+
+//the model with the highest score, the first one on a tie as in recognise
+int best(vector<double> &score);
+
+/* Runs every recognition sample through the double, float and int16 engines and reports how
+ * often the best character of the reduced engines differs from the double one.
+ */
+int main(){
+	fs::path optimisedData_path("./data/trainingData/localOptimisedData/");
+	fs::path recognitionData_path("./data/recognitionData/localFeatureData/");
+
+	if(!fs::exists(optimisedData_path)||!fs::exists(recognitionData_path)){
+		cout<<"Cannot read the direcotry"<<endl;
+		return 1;
+	}
+
+	vector<rh::Model> models;
+	vector<rh::ReducedModel> reducedModels;
+	fs::directory_iterator end_itr;
+	for(fs::directory_iterator itr(optimisedData_path); itr!=end_itr; ++itr){	//each directory represent one character
+		if(fs::is_directory(*itr)){
+			rh::Model model;
+			model.load("./data/trainingData/localOptimisedData/"+itr->leaf()+"_dis.txt", "./data/trainingData/localOptimisedData/"+itr->leaf()+"_tran.txt");
+			models.push_back(model);
+			reducedModels.push_back(rh::ReducedModel());
+			reducedModels.back().set(model);
+		}
+	}
+
+	int samples = 0;
+	int floatDiffers = 0;
+	int fixedDiffers = 0;
+	double floatError = 0;//largest difference to a finite double score
+	double fixedError = 0;
+	double time[3] = {0, 0, 0};
+	vector<double> score[3];
+
+	for(fs::directory_iterator itr(recognitionData_path); itr!=end_itr; ++itr){
+		if(!fs::is_directory(*itr)){
+			continue;
+		}
+		for(fs::directory_iterator sub_itr(*itr); sub_itr!=end_itr; ++sub_itr){
+			if(fs::is_directory(*sub_itr)){
+				continue;
+			}
+			vector<int> observation = rh::Viterbi::readObservation("./data/recognitionData/localFeatureData/"+itr->leaf()+"/"+sub_itr->leaf());
+			if(observation.size()==0){
+				continue;
+			}
+			for(int e=0; e<3; e++){
+				score[e].resize(models.size());
+				clock_t start = clock();
+				for(int m=0; m<models.size(); m++){
+					if(e==0) score[e][m] = rh::Viterbi::Calculate_probability(models[m], observation);
+					if(e==1) score[e][m] = rh::ReducedViterbi::Calculate_probability_float(reducedModels[m], observation);
+					if(e==2) score[e][m] = rh::ReducedViterbi::Calculate_probability_fixed(reducedModels[m], observation);
+				}
+				time[e] += (double)(clock()-start)/CLOCKS_PER_SEC;
+			}
+			for(int m=0; m<models.size(); m++){
+				if(score[0][m]>rh::LOGZERO){
+					floatError = max(floatError, fabs(score[1][m]-score[0][m]));
+					fixedError = max(fixedError, fabs(score[2][m]-score[0][m]));
+				}
+			}
+			int reference = best(score[0]);
+			if(best(score[1])!=reference) floatDiffers++;
+			if(best(score[2])!=reference) fixedDiffers++;
+			samples++;
+		}
+	}
+
+	cout<<samples<<" samples against "<<models.size()<<" models"<<endl;
+	cout<<"double:\t"<<time[0]<<"s"<<endl;
+	cout<<"float:\t"<<time[1]<<"s, top 1 differs for "<<floatDiffers<<" ("<<(samples>0 ? 100.0*floatDiffers/samples : 0)<<"%), largest score difference "<<floatError<<endl;
+	cout<<"int16:\t"<<time[2]<<"s, top 1 differs for "<<fixedDiffers<<" ("<<(samples>0 ? 100.0*fixedDiffers/samples : 0)<<"%), largest score difference "<<fixedError<<endl;
+
+	return 0;
+}
+
+int best(vector<double> &score){
+	int bestModel = 0;
+	for(int m=1; m<score.size(); m++){
+		if(score[m]>score[bestModel]){
+			bestModel = m;
+		}
+	}
+	return bestModel;
+}
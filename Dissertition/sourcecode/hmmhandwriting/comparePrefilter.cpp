@@ -0,0 +1,135 @@
+#include <iostream>
+#include <string>
+#include <time.h>
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/path.hpp>
+#include "CompiledModels.h"
+#include "ModelBank.h"
+#include "Prefilter.h"
+#include "Viterbi.h"
+#include "ViterbiResult.h"
+#include <vector>
+
+namespace fs = boost::filesystem;
+namespace rh = redhat;
+using namespace std;
+
+//the model with the highest score, the first one on a tie as in recognise
+int best(const vector<rh::ViterbiResult> &results);
+
+const int REPEAT = 200;//every sample is timed this many times, one is too short for clock()
+
+/* Runs every recognition sample through the prefilter with shortlists of several sizes M and
+ * reports, for each M, how often the best character of decoding every model is on the
+ * shortlist (recall@M), how often the best of the shortlist is that character and how often it
+ * is the character the sample was written as, next to the time the prefilter and the decoding
+ * of the shortlist take a sample. The models are decoded the way recognise does it, with the
+ * compiled models if they are there, after the stroke count filter.
+ */
+int main(){
+	fs::path optimisedData_path("./data/trainingData/localOptimisedData/");
+	fs::path recognitionData_path("./data/recognitionData/localFeatureData/");
+
+	if(!fs::exists(optimisedData_path)||!fs::exists(recognitionData_path)){
+		cout<<"Cannot read the direcotry"<<endl;
+		return 1;
+	}
+
+	rh::ModelBank modelBank;
+	fs::directory_iterator end_itr;
+	for(fs::directory_iterator itr(optimisedData_path); itr!=end_itr; ++itr){	//each directory represent one character
+		if(fs::is_directory(*itr)){
+			modelBank.add(itr->leaf(), "./data/trainingData/localOptimisedData/"+itr->leaf()+"_dis.txt", "./data/trainingData/localOptimisedData/"+itr->leaf()+"_tran.txt");
+		}
+	}
+	modelBank.pack();
+	rh::CompiledModels compiledModels;
+	compiledModels.load("./data/trainingData/compiledModels/"+rh::CompiledModels::libraryName());
+
+	vector< vector<int> > observations;
+	vector<string> labels;//the character each sample was written as
+	for(fs::directory_iterator itr(recognitionData_path); itr!=end_itr; ++itr){
+		if(!fs::is_directory(*itr)){
+			continue;
+		}
+		for(fs::directory_iterator sub_itr(*itr); sub_itr!=end_itr; ++sub_itr){
+			if(fs::is_directory(*sub_itr)){
+				continue;
+			}
+			vector<int> observation = rh::Viterbi::readObservation("./data/recognitionData/localFeatureData/"+itr->leaf()+"/"+sub_itr->leaf());
+			if(observation.size()>0){
+				observations.push_back(observation);
+				labels.push_back(itr->leaf());
+			}
+		}
+	}
+
+	//the best character and the time of decoding every candidate
+	vector<int> reference(observations.size());
+	vector< vector<bool> > candidates(observations.size());
+	double referenceTime = 0;
+	int referenceCorrect = 0;
+	for(int o=0; o<observations.size(); o++){
+		candidates[o] = modelBank.candidates(observations[o], rh::ModelBank::strokeTolerance());
+		vector<rh::ViterbiResult> results;
+		clock_t start = clock();
+		for(int r=0; r<REPEAT; r++){
+			results = compiledModels.score(modelBank, observations[o], candidates[o]);
+		}
+		referenceTime += (double)(clock()-start)/CLOCKS_PER_SEC/REPEAT;
+		reference[o] = best(results);
+		if(modelBank.characters[reference[o]]==labels[o]) referenceCorrect++;
+	}
+
+	int samples = observations.size();
+	cout<<samples<<" samples against "<<modelBank.models.size()<<" models"<<endl;
+	if(samples==0){
+		return 0;
+	}
+	cout<<"M\trecall@M\tsame best\tcorrect\tprefilter ms\tdecode ms\ttotal ms"<<endl;
+	int sizes[] = {1, 2, 3, 4, 5, 6, 8, 10, 15, 20};
+	for(int s=0; s<10; s++){
+		int size = sizes[s];
+		int recalled = 0;
+		int same = 0;
+		int correct = 0;
+		double prefilterTime = 0;
+		double decodeTime = 0;
+		for(int o=0; o<samples; o++){
+			vector<bool> shortlist;
+			clock_t start = clock();
+			for(int r=0; r<REPEAT; r++){
+				shortlist = modelBank.prefilter.shortlist(observations[o], candidates[o], size);
+			}
+			prefilterTime += (double)(clock()-start)/CLOCKS_PER_SEC/REPEAT;
+			vector<rh::ViterbiResult> results;
+			start = clock();
+			for(int r=0; r<REPEAT; r++){
+				results = compiledModels.score(modelBank, observations[o], shortlist);
+			}
+			decodeTime += (double)(clock()-start)/CLOCKS_PER_SEC/REPEAT;
+			int found = best(results);
+			if(shortlist[reference[o]]){
+				recalled++;
+				if(found==reference[o]) same++;
+			}
+			if(modelBank.characters[found]==labels[o]) correct++;
+		}
+		cout<<size<<"\t"<<100.0*recalled/samples<<"%\t\t"<<100.0*same/samples<<"%\t\t"<<100.0*correct/samples<<"%\t";
+		cout<<1000*prefilterTime/samples<<"\t\t"<<1000*decodeTime/samples<<"\t\t"<<1000*(prefilterTime+decodeTime)/samples<<endl;
+	}
+	cout<<"all\t100%\t\t100%\t\t"<<100.0*referenceCorrect/samples<<"%\t0\t\t"<<1000*referenceTime/samples<<"\t\t"<<1000*referenceTime/samples<<endl;
+
+	return 0;
+}
+
+int best(const vector<rh::ViterbiResult> &results){
+	int bestModel = 0;
+	for(int m=1; m<results.size(); m++){
+		if(results[m].probability>results[bestModel].probability){
+			bestModel = m;
+		}
+	}
+	return bestModel;
+}
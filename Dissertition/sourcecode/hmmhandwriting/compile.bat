@@ -1,4 +1,9 @@
 cl quantilise.cpp
-cl optimise.cpp
+cl /openmp optimise.cpp
 cl quantiliseReco.cpp
-cl recognise.cpp
\ No newline at end of file
+cl recognise.cpp
+cl comparePrecision.cpp
+cl compileModels.cpp
+cl /openmp compareEngines.cpp
+cl comparePrefilter.cpp
+cl compareIndex.cpp
\ No newline at end of file
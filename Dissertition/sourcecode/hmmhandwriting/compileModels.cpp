@@ -0,0 +1,55 @@
+#include <iostream>
+#include <string>
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/filesystem/path.hpp>
+#include "Model.h"
+#include "CompiledModels.h"
+#include <vector>
+
+namespace fs = boost::filesystem;
+namespace rh = redhat;
+using namespace std;
+
+/* Writes the source of the compiled models for every optimised model, to be built into the
+ * shared library recognise loads. Run it again, and build again, after optimise.
+ */
+int main(){
+	fs::path optimisedData_path("./data/trainingData/localOptimisedData/");
+	fs::path compiledData_path("./data/trainingData/compiledModels/");
+
+	if(!fs::exists(optimisedData_path)){
+		cout<<"Cannot read the direcotry"<<endl;
+		return 1;
+	}
+	if(!fs::exists(compiledData_path)){
+		fs::create_directory(compiledData_path);
+	}
+
+	vector<rh::Model> models;
+	vector<string> characters;
+	fs::directory_iterator end_itr;
+	for(fs::directory_iterator itr(optimisedData_path); itr!=end_itr; ++itr){	//each directory represent one character
+		if(fs::is_directory(*itr)){
+			rh::Model model;
+			model.load("./data/trainingData/localOptimisedData/"+itr->leaf()+"_dis.txt", "./data/trainingData/localOptimisedData/"+itr->leaf()+"_tran.txt");
+			models.push_back(model);
+			characters.push_back(itr->leaf());
+		}
+	}
+
+	fs::ofstream sourceFile(compiledData_path/"compiledModels.cpp");
+	if(!sourceFile){
+		cout<<"Cannot open file.\n";
+		return 1;
+	}
+	rh::CompiledModels::generate(models, characters, sourceFile);
+	sourceFile.close();
+
+	cout<<models.size()<<" models written to "<<(compiledData_path/"compiledModels.cpp").string()<<endl;
+	cout<<"build it in that directory with"<<endl;
+	cout<<"\tcl /O2 /LD compiledModels.cpp"<<endl;
+	cout<<"or"<<endl;
+	cout<<"\tg++ -O2 -shared -fPIC -o compiledModels.so compiledModels.cpp"<<endl;
+	return 0;
+}
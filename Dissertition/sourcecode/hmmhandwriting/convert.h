@@ -1,3 +1,6 @@
+#ifndef __CONVERT__
+#define __CONVERT__
+
 #include <iostream>
 #include <sstream>
 #include <string>
@@ -27,4 +30,6 @@ namespace redhat{
 			 throw redhat::Conversion("convertToInt(\""+ s + "\")");
 		return x;
 	}
-}
\ No newline at end of file
+}
+
+#endif //__CONVERT__
\ No newline at end of file
@@ -5,6 +5,10 @@
 #include <boost/filesystem/path.hpp>
 #include "State.h"
 #include "Stroke.h"
+#include "Model.h"
+#include "ModelBank.h"
+#include "ShortlistIndex.h"
+#include "BatchViterbi.h"
 #include "Viterbi.h"
 #include "ViterbiResult.h"
 
@@ -32,6 +36,35 @@ int main(){
 		}
 	}
 	
+	//index the optimised models for the shortlist of recognise, see ShortlistIndex. a model that
+	//can't be read is left out, recognise scores the models the index hasn't got anyway
+	rh::ModelBank modelBank;
+	fs::path optimisedData_path("./data/trainingData/localOptimisedData/");
+	if(!fs::exists(optimisedData_path)){
+		cout<<"Cannot read the direcotry"<<endl;
+		return 1;
+	}
+	for(fs::directory_iterator itr(optimisedData_path); itr!=end_itr; ++itr){
+		if(fs::is_directory(*itr)){
+			try{
+				rh::Model model;
+				model.load("./data/trainingData/localOptimisedData/"+itr->leaf()+"_dis.txt", "./data/trainingData/localOptimisedData/"+itr->leaf()+"_tran.txt");
+				if(model.stateNum>0){
+					modelBank.add(itr->leaf(), model);
+				}
+			}catch(...){
+				cout<<"Exception when reading the model of "<<itr->leaf()<<" for the shortlist index\n";
+			}
+		}
+	}
+	try{
+		rh::ShortlistIndex shortlistIndex;
+		shortlistIndex.build(modelBank);
+		shortlistIndex.save("./data/trainingData/shortlistIndex.txt");
+	}catch(...){
+		cout<<"Exception when building the shortlist index\n";
+	}
+	
 	return 0;
 }
 
@@ -40,11 +73,18 @@ void parseFile(fs::path repository_path, string disProbFilePath, string tranProb
 	int feature[300];
 	int numOfState = 0;
 	int numOfFeature = 0;
-	int tranState[150]; //used to calculate transition probabilityy
+	int tranState[150] = {0}; //used to calculate transition probabilityy, counted up from 0
 	int trainingTimes = 0; //used to calculate transition probability
 	double optimisedTranMatrixSource[100]; 
 	double optimisedTransitionMatrix[100][100];// = new double[100][100];
 	
+	//the model is read once for all the samples of the character, and they are all decoded together
+	rh::Model model;
+	model.load(disProbFilePath, tranProbFilePath);
+	vector<string> samples;
+	vector< vector<int> > observations;
+	vector<rh::ViterbiResult> results;
+	
 //	for(int i=0; i<15; i++){
 //		for(int j=0; j<15; j++){
 //			cout<<optimisedTransitionMatrix[i][j]<<"\t";
@@ -55,58 +95,59 @@ void parseFile(fs::path repository_path, string disProbFilePath, string tranProb
 		//trversal the subdirecotry
 		fs::directory_iterator end_sub_itr;
 		for(fs::directory_iterator sub_itr(repository_path); sub_itr!=end_sub_itr; ++sub_itr){
-			if(is_directory(*sub_itr)){
-				//do nothing
-			}else{
+			if(!is_directory(*sub_itr)){
 				string observationPath = "./data/trainingData/localInitialData/"+repository_path.leaf()+"/"+sub_itr->leaf();
-				
-				string line;
-				fs::ifstream observationFile(observationPath);
-				if(!observationFile){
-					cout<<"Cannot open file.\n";
-				}else{
-					while(!observationFile.eof()){
-						getline(observationFile, line);
-						if(line.compare("")==0){//do nothing
-						}else{
-							feature[numOfFeature]=rh::convertToInt(line);
-							numOfFeature++;
-						}
-					}
-				}
-				observationFile.close();
-				
-				rh::ViterbiResult result;
-				
+				samples.push_back(sub_itr->leaf());
+				observations.push_back(vector<int>());
 				try{
-					result = rh::Viterbi::Calculate_path_and_probability(disProbFilePath, observationPath, tranProbFilePath);
-//					cout<<"finish processing: "<<observationPath<<endl;
-				}catch(...){
+					observations.back() = rh::Viterbi::readObservation(observationPath);
+				}catch(...){//left empty, it decodes to LOGZERO with no path and adds nothing
 					cout<<"Viterbi Exception when processing file "+observationPath+".\n";
 				}
-				
-				//intermedia value: the state sequence  -- start
-				string stateSequanceDirectoryPath = "./data/trainingData/localOptimisedData/"+repository_path.leaf();
-				fs::create_directory(stateSequanceDirectoryPath);
-				string stateSequencePath = stateSequanceDirectoryPath+"/"+sub_itr->leaf();
-				fs::ofstream stateSequence(stateSequencePath);
-				if(!stateSequence){
-					cout<<"Cannot open file!"<<endl;
+			}
+		}
+		try{
+			rh::BatchViterbi::decode(model, observations, results);
+		}catch(...){
+			cout<<"Viterbi Exception when processing "+repository_path.leaf()+".\n";
+		}
+		for(int sample=0; sample<samples.size(); sample++){
+			//the features of the sample, as read for the decode above
+			const vector<int> &observation = observations[sample];
+			for(int i=0; i<observation.size() && numOfFeature<300; i++){
+				feature[numOfFeature] = observation[i];
+				numOfFeature++;
+			}
+			
+			vector<int> &path = results[sample].path;
+			
+			//intermedia value: the state sequence  -- start
+			string stateSequanceDirectoryPath = "./data/trainingData/localOptimisedData/"+repository_path.leaf();
+			fs::create_directory(stateSequanceDirectoryPath);
+			string stateSequencePath = stateSequanceDirectoryPath+"/"+samples[sample];
+			fs::ofstream stateSequence(stateSequencePath);
+			if(!stateSequence){
+				cout<<"Cannot open file!"<<endl;
+			}
+			for(int i=0; i<path.size(); i++){
+				stateSequence<<path.at(i)<<endl;
+				if(path.at(i)<0){//a sample that can't fit the model has no state here
+					continue;
 				}
-				for(int i=0; i<result.path.size(); i++){
-					stateSequence<<result.path.at(i)<<endl;
-					tranState[result.path.at(i)]++;//calculate the total number of the feature in each state
+				tranState[path.at(i)]++;//calculate the total number of the feature in each state
+			}
+			stateSequence.close();
+			//intermedia value -- end
+			
+			for(int i=0; i<path.size(); i++){
+				int stateIndex = path.at(i);
+				if(stateIndex<0){
+					continue;
 				}
-				stateSequence.close();
-				//intermedia value -- end
-				
-				for(int i=0; i<result.path.size(); i++){
-					int stateIndex = result.path.at(i);
-					if(stateIndex > numOfState){ 
-						numOfState = stateIndex;
-					}
-					state[stateIndex].vector[feature[stateIndex]]++;
+				if(stateIndex > numOfState){ 
+					numOfState = stateIndex;
 				}
+				state[stateIndex].vector[feature[stateIndex]]++;
 			}
 //			trainingTimes++;//should not be used anymore
 	//		//tst
@@ -6,6 +6,13 @@
 #include "State.h"
 #include "Stroke.h"
 #include "Viterbi.h"
+#include "ModelBank.h"
+#include "CompiledModels.h"
+#include "Forward.h"
+#include "Ranking.h"
+#include "BeamViterbi.h"
+#include "Prefilter.h"
+#include "ShortlistIndex.h"
 #include "ViterbiResult.h"
 #include <vector>
 
@@ -13,8 +20,6 @@ namespace fs = boost::filesystem;
 namespace rh = redhat;
 using namespace std;
 
-vector<rh::ViterbiResult> insert(vector<rh::ViterbiResult> resultSequence, rh::ViterbiResult item, int i);
-
 int main(){
 	fs::path configFilePath("./data/recognitionData/path.txt");
 	fs::ifstream configFile(configFilePath);
@@ -38,36 +43,54 @@ int main(){
 	
 	fs::directory_iterator end_itr;
 	
+	//load every character model into one bank and score the observation against all of them in one pass
+	rh::ModelBank modelBank;
 	for(fs::directory_iterator itr(optimisedData_path); itr!=end_itr; ++itr){	//each directory represent one character
 		if(fs::is_directory(*itr)){
-			//TEST
 			string disPath = "./data/trainingData/localOptimisedData/"+itr->leaf()+"_dis.txt";
 			string tranPath = "./data/trainingData/localOptimisedData/"+itr->leaf()+"_tran.txt";//tempararily use initial transition probability
-			
-			rh::ViterbiResult result = rh::Viterbi::Calculate_path_and_probability(disPath, recognitionData_path, tranPath);
-			result.character=itr->leaf();
-			
-//			cout<<result.probability<<endl;
-//			cout<<recognitionResult.size()<<endl;
-			if(recognitionResult.size()==0){
-				recognitionResult.push_back(result);
-//				cout<<recognitionResult.size()<<endl;
-			}else{
-				int i=0;
-				bool keepGoing=true;
-				while(i<recognitionResult.size()&&keepGoing){
-					if(recognitionResult.at(i).probability<result.probability){
-						recognitionResult = insert(recognitionResult, result, i);
-						keepGoing=false;
-					}else if(i==(recognitionResult.size()-1)){
-						recognitionResult.push_back(result);
-						keepGoing=false;
-					}
-					i++;
-				}
-			}
+			modelBank.add(itr->leaf(), disPath, tranPath);
 		}
 	}
+	
+	//the decoders built for these models by compileModels, if there are any
+	rh::CompiledModels compiledModels;
+	compiledModels.load("./data/trainingData/compiledModels/"+rh::CompiledModels::libraryName());
+	
+	vector<int> observation = rh::Viterbi::readObservation(recognitionData_path);
+	//only the models for as many strokes as the observation has, the others can't end in their last state
+	vector<bool> candidates = modelBank.candidates(observation, rh::ModelBank::strokeTolerance());
+	//and of those, with RH_PREFILTER, the ones whose directions fit the observation best
+	//with RH_INDEX=on found through the index optimise built, without scoring every model
+	rh::ShortlistIndex shortlistIndex;
+	if(rh::Prefilter::size()>0 && rh::ShortlistIndex::use() && shortlistIndex.load("./data/trainingData/shortlistIndex.txt")){
+		candidates = shortlistIndex.shortlist(modelBank, observation, rh::ModelBank::strokeTolerance(), rh::Prefilter::size());
+	}else if(rh::Prefilter::size()>0){
+		candidates = modelBank.prefilter.shortlist(observation, candidates, rh::Prefilter::size());
+	}
+	//rank by the best path of each model, or with RH_RANKING=forward by the likelihood over all its paths.
+	//with RH_BEAM a model is given up once it can't make the RH_NBEST best, see BeamViterbi, and
+	//with RH_SEARCH=bound only the models that might make them are decoded, and exactly, RH_BEAM or not
+	vector<rh::ViterbiResult> bankResult;
+	rh::Beam beam(rh::Beam::setting());
+	bool counted = rh::Beam::setting()>=0 || rh::ModelBank::search().compare("bound")==0;
+	if(rh::Forward::ranking().compare("forward")==0){
+		bankResult = modelBank.scoreForward(observation, candidates);
+		counted = false;
+	}else if(rh::ModelBank::search().compare("bound")==0){
+		bankResult = modelBank.scoreBound(observation, candidates, rh::Ranking::nBest(), beam);
+	}else if(rh::Beam::setting()>=0){
+		bankResult = modelBank.scoreBeam(observation, candidates, rh::Ranking::nBest(), beam);
+	}else{
+		bankResult = compiledModels.score(modelBank, observation, candidates);
+	}
+	
+	//keep the RH_NBEST best characters, or all of them
+	rh::Ranking ranking(rh::Ranking::nBest(), false);
+	for(int m=0; m<bankResult.size(); m++){
+		ranking.add(bankResult.at(m));
+	}
+	recognitionResult = ranking.best();
 	//tst display the probability
 	for(int i=0; i<recognitionResult.size(); i++){
 		cout<<recognitionResult.at(i).probability<<endl;
@@ -76,6 +99,9 @@ int main(){
 	for(int i=0; i<recognitionResult.size(); i++){
 		cout<<i+1<<"\t"<<recognitionResult.at(i).character<<endl;
 	}
+	if(counted){
+		cout<<"Beam: "<<beam.decodes<<" models decoded, "<<beam.cells<<" nodes worked out, "<<beam.skipped<<" skipped, "<<beam.givenUp<<" models given up"<<endl;
+	}
 	
 	//output results
 	fs::path resultFilePath("./data/recognitionData/results/"+line2+".txt");
@@ -89,11 +115,4 @@ int main(){
 	resultFile.close();
 	
 	return 0;
-}
-
-vector<rh::ViterbiResult> insert(vector<rh::ViterbiResult> resultSequence, rh::ViterbiResult item, int i){
-	vector<rh::ViterbiResult>::iterator indexIterator;
-	indexIterator=resultSequence.begin()+i;
-	resultSequence.insert(indexIterator, item);
-	return resultSequence;
-} 
\ No newline at end of file
+}
\ No newline at end of file
@@ -0,0 +1,64 @@
+#include <iostream>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "../Arena.h"
+#include "../Backpointers.h"
+#include "../Model.h"
+
+namespace rh = redhat;
+using namespace std;
+
+//fill columns of random previous states every left-to-right node can have and count those read back wrong
+int roundTrip(int stateNum, int columns, int jumpWidth, int bandWidth){
+	rh::Arena arena;
+	rh::Backpointers backpointers;
+	backpointers.reset(arena, stateNum, columns, jumpWidth, true);
+
+	//a jump back of 0..jumpWidth, a jump from the first state up to bandWidth, never reached, -1 and -2
+	vector<int> path(stateNum*columns);
+	for(int i=0; i<columns; i++){
+		for(int j=0; j<stateNum; j++){
+			int value = rand()%(jumpWidth+5);
+			if(value<=jumpWidth){
+				path[i*stateNum+j] = j-value<0 ? 0 : j-value;
+			}else if(value==jumpWidth+1){
+				path[i*stateNum+j] = j<=bandWidth ? 0 : j;
+			}else if(value==jumpWidth+2){
+				path[i*stateNum+j] = stateNum-1;
+			}else{
+				path[i*stateNum+j] = jumpWidth+2-value;
+			}
+		}
+		backpointers.setColumn(i, &path[i*stateNum]);
+	}
+
+	int wrong = 0;
+	for(int i=0; i<columns; i++){
+		for(int j=0; j<stateNum; j++){
+			if(backpointers.get(i, j)!=path[i*stateNum+j]){
+				wrong++;
+			}
+		}
+	}
+	cout<<stateNum<<" states, jumps of "<<jumpWidth<<", band of "<<bandWidth<<": ";
+	cout<<backpointers.bits<<" bits a node, "<<backpointers.bytes()<<" bytes instead of "<<stateNum*columns*sizeof(int)<<endl;
+	cout<<wrong<<" nodes read back wrong"<<endl;
+	return wrong;
+}
+
+int main(){
+	int wrong = roundTrip(15, 200, 3, 3);
+
+	//the initial models: the first state's row reaches every state, so the band is stateNum-1,
+	//and the width of a node still only depends on the jumps of the strokes
+	rh::Model model;
+	model.load("../data/trainingData/localInitialData/4.1_dis.txt", "../data/trainingData/localInitialData/4.1_tran.txt");
+	if(model.stateNum==0){
+		cout<<"Cannot load the model.\n";
+		return 1;
+	}
+	wrong += roundTrip(model.stateNum, 200, model.jumpWidth, model.bandWidth);
+
+	return wrong>0 ? 1 : 0;
+}
@@ -0,0 +1,45 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../Model.h"
+#include "../DecoderWorkspace.h"
+#include "../BatchViterbi.h"
+#include "../Viterbi.h"
+#include "../ViterbiResult.h"
+
+namespace rh = redhat;
+using namespace std;
+
+int main(){
+	string disPath = "../data/trainingData/localInitialData/4.1_dis.txt";
+	string obePath = "../data/trainingData/localInitialData/4.1/4.1.1.txt";
+	string tranPath= "../data/trainingData/localInitialData/4.1_tran.txt";
+
+	rh::Model model;
+	model.load(disPath, tranPath);
+	vector<int> observation = rh::Viterbi::readObservation(obePath);
+	if(model.stateNum==0 || observation.size()==0){
+		cout<<"Cannot load the model or the observation.\n";
+		return 1;
+	}
+
+	//the sample cut short in different places, so the lanes run out at different columns
+	vector< vector<int> > observations;
+	for(int length=observation.size(); length>0; length-=3){
+		observations.push_back(vector<int>(observation.begin(), observation.begin()+length));
+	}
+	vector<rh::ViterbiResult> results;
+	rh::BatchViterbi::decode(model, observations, results);
+
+	rh::DecoderWorkspace workspace;
+	int differ = 0;
+	for(int s=0; s<observations.size(); s++){
+		rh::Viterbi::decode(model, observations[s], workspace);
+		if(workspace.probability!=results[s].probability || workspace.path!=results[s].path){
+			differ++;
+		}
+	}
+	cout<<observations.size()<<" observations in lanes of "<<rh::BatchViterbi::LANES<<", "<<differ<<" differ from Viterbi::decode"<<endl;
+
+	return differ==0 ? 0 : 1;
+}
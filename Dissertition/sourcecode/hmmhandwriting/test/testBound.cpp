@@ -0,0 +1,71 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+#include "../BeamViterbi.h"
+#include "../ModelBank.h"
+#include "../Ranking.h"
+#include "../Viterbi.h"
+#include "../ViterbiResult.h"
+
+namespace rh = redhat;
+namespace fs = boost::filesystem;
+using namespace std;
+
+//the nBest best of a bank's results, as recognise ranks them
+vector<rh::ViterbiResult> best(const vector<rh::ViterbiResult> &results, int nBest){
+	rh::Ranking ranking(nBest, false);
+	for(int m=0; m<results.size(); m++){
+		ranking.add(results[m]);
+	}
+	return ranking.best();
+}
+
+int main(){
+	string modelPath = "../data/trainingData/localOptimisedData/";
+	string featurePath = "../data/recognitionData/localFeatureData/";
+	rh::ModelBank bank;
+	fs::directory_iterator end_itr;
+	for(fs::directory_iterator itr(modelPath); itr!=end_itr; ++itr){
+		if(fs::is_directory(*itr)){
+			bank.add(itr->leaf(), modelPath+itr->leaf()+"_dis.txt", modelPath+itr->leaf()+"_tran.txt");
+		}
+	}
+	if(bank.models.size()==0){
+		cout<<"Cannot load the models.\n";
+		return 1;
+	}
+
+	bool same = true;
+	int samples = 0;
+	rh::Beam beam(0);
+	for(fs::directory_iterator itr(featurePath); itr!=end_itr; ++itr){
+		if(!fs::is_directory(*itr)){
+			continue;
+		}
+		for(fs::directory_iterator sub_itr(*itr); sub_itr!=end_itr; ++sub_itr){
+			vector<int> observation = rh::Viterbi::readObservation(featurePath+itr->leaf()+"/"+sub_itr->leaf());
+			if(observation.size()==0){
+				continue;
+			}
+			samples++;
+			vector<bool> candidates(bank.models.size(), true);
+			vector<rh::ViterbiResult> exhaustive = bank.score(observation, candidates);
+			for(int m=0; m<bank.models.size(); m++){//a bound is never below the score
+				same = same && !(exhaustive[m].probability>bank.bound(m, observation));
+			}
+			for(int nBest=1; nBest<=3; nBest++){
+				vector<rh::ViterbiResult> expected = best(exhaustive, nBest);
+				vector<rh::ViterbiResult> found = best(bank.scoreBound(observation, candidates, nBest, beam), nBest);
+				same = same && found.size()==expected.size();
+				for(int i=0; i<found.size() && i<expected.size(); i++){
+					same = same && found[i].character==expected[i].character && found[i].probability==expected[i].probability;
+				}
+			}
+		}
+	}
+	cout<<samples<<" samples, "<<beam.decodes<<" decodes for "<<3*samples*bank.models.size()<<" models"<<endl;
+	cout<<(same ? "same as decoding every model" : "different from decoding every model")<<endl;
+	return same && samples>0 ? 0 : 1;//no samples read, nothing was checked
+}
@@ -0,0 +1,54 @@
+#include <iostream>
+#include <new>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "../Model.h"
+#include "../DecoderWorkspace.h"
+#include "../Viterbi.h"
+
+namespace rh = redhat;
+using namespace std;
+
+//count every heap allocation the program makes
+int allocations = 0;
+
+void *operator new(size_t size){
+	allocations++;
+	void *memory = malloc(size==0 ? 1 : size);
+	if(memory==NULL){
+		throw bad_alloc();
+	}
+	return memory;
+}
+
+void operator delete(void *memory){
+	free(memory);
+}
+
+int main(){
+	string disPath = "../data/trainingData/localInitialData/4.1_dis.txt";
+	string obePath = "../data/trainingData/localInitialData/4.1/4.1.1.txt";
+	string tranPath= "../data/trainingData/localInitialData/4.1_tran.txt";
+
+	rh::Model model;
+	model.load(disPath, tranPath);
+	vector<int> observation = rh::Viterbi::readObservation(obePath);
+	if(model.stateNum==0 || observation.size()==0){
+		cout<<"Cannot load the model or the observation.\n";
+		return 1;
+	}
+	rh::DecoderWorkspace workspace;
+
+	//the first decode sizes the workspace
+	rh::Viterbi::decode(model, observation, workspace);
+
+	int before = allocations;
+	for(int i=0; i<100; i++){
+		rh::Viterbi::decode(model, observation, workspace);
+	}
+	cout<<"probability "<<workspace.probability<<", path of "<<workspace.path.size()<<" states"<<endl;
+	cout<<allocations-before<<" allocations in 100 decodes after the first"<<endl;
+
+	return allocations==before ? 0 : 1;
+}
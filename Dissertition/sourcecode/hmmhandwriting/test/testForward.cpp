@@ -0,0 +1,69 @@
+#include <iostream>
+#include <math.h>
+#include <string>
+#include <vector>
+#include "../Model.h"
+#include "../Forward.h"
+#include "../Viterbi.h"
+
+namespace rh = redhat;
+using namespace std;
+
+//log(exp(a)+exp(b))
+double logAdd(double a, double b){
+	if(a==rh::LOGZERO) return b;
+	if(b==rh::LOGZERO) return a;
+	double larger = a>b ? a : b;
+	return larger+log(exp(a-larger)+exp(b-larger));
+}
+
+int main(){
+	string disPath = "../data/trainingData/localInitialData/4.1_dis.txt";
+	string obePath = "../data/trainingData/localInitialData/4.1/4.1.1.txt";
+	string tranPath= "../data/trainingData/localInitialData/4.1_tran.txt";
+
+	rh::Model model;
+	model.load(disPath, tranPath);
+	vector<int> observation = rh::Viterbi::readObservation(obePath);
+	if(model.stateNum==0 || observation.size()==0){
+		cout<<"Cannot load the model or the observation.\n";
+		return 1;
+	}
+	rh::ForwardModel forwardModel;
+	forwardModel.set(model);
+	double probability = rh::Forward::Calculate_probability(forwardModel, observation);
+	double bestPath = rh::Viterbi::Calculate_probability(model, observation);
+
+	//the forward algorithm in log space over every pair of states, with the same stroke markers
+	int stateNum = model.stateNum;
+	vector<double> previous(stateNum, rh::LOGZERO);
+	vector<double> next(stateNum);
+	previous[0] = model.distribution(0, rh::Model::direction(observation[0]));
+	int currentStrokeNum = 1;
+	for(int i=1; i<observation.size(); i++){
+		int symbol = observation[i];
+		int forcedState = -1;
+		if(symbol>15){
+			currentStrokeNum++;
+			forcedState = (currentStrokeNum-1)*rh::STATENO;
+		}else if(symbol<0){
+			forcedState = currentStrokeNum*rh::STATENO-1;
+		}
+		for(int j=0; j<stateNum; j++){
+			next[j] = rh::LOGZERO;
+			if(forcedState>=0 && j!=forcedState){
+				continue;
+			}
+			for(int k=0; k<stateNum; k++){
+				next[j] = logAdd(next[j], previous[k]+model.transition(k, j));
+			}
+			next[j] += model.distribution(j, rh::Model::direction(symbol));
+		}
+		previous.swap(next);
+	}
+	double expected = previous[stateNum-1];
+
+	cout<<"forward "<<probability<<", in log space "<<expected<<", best path "<<bestPath<<endl;
+	bool same = fabs(probability-expected)<=1e-9*fabs(expected) && probability>=bestPath;
+	return same ? 0 : 1;
+}
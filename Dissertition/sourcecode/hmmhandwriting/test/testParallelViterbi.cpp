@@ -0,0 +1,39 @@
+#include <iostream>
+#include <math.h>
+#include <string>
+#include <vector>
+#include "../Model.h"
+#include "../DecoderWorkspace.h"
+#include "../ParallelViterbi.h"
+#include "../Viterbi.h"
+
+namespace rh = redhat;
+using namespace std;
+
+int main(){
+	string disPath = "../data/trainingData/localInitialData/4.1_dis.txt";
+	string obePath = "../data/trainingData/localInitialData/4.1/4.1.1.txt";
+	string tranPath= "../data/trainingData/localInitialData/4.1_tran.txt";
+
+	rh::Model model;
+	model.load(disPath, tranPath);
+	vector<int> observation = rh::Viterbi::readObservation(obePath);
+	if(model.stateNum==0 || observation.size()==0){
+		cout<<"Cannot load the model or the observation.\n";
+		return 1;
+	}
+	rh::DecoderWorkspace sequential;
+	rh::DecoderWorkspace parallel;
+	rh::Viterbi::decode(model, observation, sequential);
+	cout<<rh::ParallelViterbi::threads()<<" threads"<<endl;
+	cout<<"sequential: probability "<<sequential.probability<<endl;
+
+	bool same = true;
+	for(int chunkNum=2; chunkNum<=4; chunkNum++){//short as it is, cut it anyway
+		rh::ParallelViterbi::decode(model, observation, parallel, chunkNum);
+		bool samePath = parallel.path==sequential.path;
+		cout<<chunkNum<<" chunks: probability "<<parallel.probability<<(samePath ? ", same path" : ", different path")<<endl;
+		same = same && samePath && fabs(parallel.probability-sequential.probability)<=1e-9*fabs(sequential.probability);
+	}
+	return same ? 0 : 1;
+}
@@ -0,0 +1,53 @@
+#include <iostream>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "../Constants.h"
+#include "../Ranking.h"
+#include "../ViterbiResult.h"
+
+namespace rh = redhat;
+using namespace std;
+
+int main(){
+	//scores with many ties and some LOGZERO, as a bank gives them
+	srand(2007);
+	vector<rh::ViterbiResult> results(200);
+	for(int i=0; i<results.size(); i++){
+		results[i].probability = rand()%6==0 ? rh::LOGZERO : -(double)(rand()%20);
+		results[i].character = string(1, (char)('a'+i%26))+(char)('0'+i/26);
+		results[i].path.assign(10, i);
+	}
+
+	//the ranking recognise used to build: insert before the first smaller score
+	vector<rh::ViterbiResult> expected;
+	for(int i=0; i<results.size(); i++){
+		int j=0;
+		while(j<expected.size() && !(expected[j].probability<results[i].probability)){
+			j++;
+		}
+		expected.insert(expected.begin()+j, results[i]);
+	}
+
+	bool same = true;
+	int capacities[] = {0, 1, 5, 37, 199, 200, 500};
+	for(int c=0; c<7; c++){
+		rh::Ranking ranking(capacities[c], c%2==0);
+		for(int i=0; i<results.size(); i++){
+			ranking.add(results[i]);
+		}
+		vector<rh::ViterbiResult> best = ranking.best();
+		int wanted = capacities[c]==0 || capacities[c]>results.size() ? results.size() : capacities[c];
+		same = same && best.size()==wanted;
+		for(int i=0; i<best.size() && i<wanted; i++){
+			same = same && best[i].character==expected[i].character && best[i].probability==expected[i].probability;
+			same = same && best[i].path.size()==(c%2==0 ? 10 : 0);
+		}
+		if(ranking.full()){
+			same = same && ranking.threshold()==expected[wanted-1].probability;
+		}
+		cout<<"capacity "<<capacities[c]<<": "<<best.size()<<" kept, threshold "<<ranking.threshold()<<endl;
+	}
+	cout<<(same ? "same as the sorted insertion" : "different from the sorted insertion")<<endl;
+	return same ? 0 : 1;
+}
@@ -0,0 +1,56 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../BeamViterbi.h"
+#include "../Model.h"
+#include "../ModelBank.h"
+#include "../RunLength.h"
+#include "../RunViterbi.h"
+#include "../Viterbi.h"
+
+namespace rh = redhat;
+using namespace std;
+
+int main(){
+	string disPath = "../data/trainingData/localInitialData/4.1_dis.txt";
+	string obePath = "../data/trainingData/localInitialData/4.1/4.1.1.txt";
+	string tranPath= "../data/trainingData/localInitialData/4.1_tran.txt";
+
+	rh::Model model;
+	model.load(disPath, tranPath);
+	vector<int> observation = rh::Viterbi::readObservation(obePath);
+	if(model.stateNum==0 || observation.size()==0){
+		cout<<"Cannot load the model or the observation.\n";
+		return 1;
+	}
+	vector<rh::Run> runs = rh::RunLength::encode(observation);
+	cout<<observation.size()<<" observations in "<<runs.size()<<" runs"<<endl;
+	if(rh::RunLength::decode(runs)!=observation){
+		cout<<"decoding the runs does not give the observation back"<<endl;
+		return 1;
+	}
+
+	double expected = rh::Viterbi::Calculate_probability(model, observation);
+	double probability = rh::RunViterbi::Calculate_probability(model, runs);
+	cout<<"probability "<<probability<<", column by column "<<expected<<endl;
+
+	//the same model without its stroke shape, which the column by column decoder takes through the generic kernel
+	rh::Model generic = model;
+	generic.strokeStateNum = 0;
+	generic.strokeJumpNo = 0;
+	double genericExpected = rh::Viterbi::Calculate_probability(generic, observation);
+	double genericProbability = rh::RunViterbi::Calculate_probability(generic, runs);
+	cout<<"without the stroke shape "<<genericProbability<<", column by column "<<genericExpected<<endl;
+
+	//the score at the first point of every stroke, none better than the one before or than the whole
+	vector<double> strokeScores;
+	rh::Beam beam(0);
+	double strokeProbability = rh::RunViterbi::Calculate_probability(model, runs, vector<double>(), rh::LOGZERO, strokeScores, beam);
+	bool strokesFine = strokeProbability==expected && strokeScores.size()==rh::ModelBank::strokes(observation);
+	for(int s=0; s<strokeScores.size(); s++){
+		cout<<"stroke "<<s+1<<" starts at "<<strokeScores[s]<<endl;
+		strokesFine = strokesFine && strokeScores[s]>=expected && (s==0 || strokeScores[s]<=strokeScores[s-1]);
+	}
+
+	return probability==expected && genericProbability==genericExpected && strokesFine ? 0 : 1;
+}
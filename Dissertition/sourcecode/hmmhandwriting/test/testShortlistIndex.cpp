@@ -0,0 +1,74 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+#include "../ModelBank.h"
+#include "../ShortlistIndex.h"
+#include "../Viterbi.h"
+
+namespace rh = redhat;
+namespace fs = boost::filesystem;
+using namespace std;
+
+int main(){
+	string modelPath = "../data/trainingData/localOptimisedData/";
+	string featurePath = "../data/recognitionData/localFeatureData/";
+	rh::ModelBank bank;
+	fs::directory_iterator end_itr;
+	for(fs::directory_iterator itr(modelPath); itr!=end_itr; ++itr){
+		if(fs::is_directory(*itr)){
+			bank.add(itr->leaf(), modelPath+itr->leaf()+"_dis.txt", modelPath+itr->leaf()+"_tran.txt");
+		}
+	}
+	if(bank.models.size()==0){
+		cout<<"Cannot load the models.\n";
+		return 1;
+	}
+
+	//an index read back gives the shortlists of the one that was saved
+	rh::ShortlistIndex built;
+	built.build(bank);
+	built.save("shortlistIndex.txt");
+	rh::ShortlistIndex loaded;
+	bool same = loaded.load("shortlistIndex.txt");
+	fs::remove("shortlistIndex.txt");
+
+	//and a model added to the bank since, which it hasn't got, is always scored: it makes the
+	//shortlist whenever it makes the scan's
+	rh::ModelBank grown = bank;
+	grown.add("new", bank.models[0]);
+	grown.pack();
+
+	int samples = 0;
+	int recalled = 0;
+	int listed = 0;
+	for(fs::directory_iterator itr(featurePath); itr!=end_itr; ++itr){
+		if(!fs::is_directory(*itr)){
+			continue;
+		}
+		for(fs::directory_iterator sub_itr(*itr); sub_itr!=end_itr; ++sub_itr){
+			vector<int> observation = rh::Viterbi::readObservation(featurePath+itr->leaf()+"/"+sub_itr->leaf());
+			if(observation.size()==0){
+				continue;
+			}
+			samples++;
+			for(int size=1; size<=10; size++){
+				vector<bool> scan = bank.prefilter.shortlist(observation, bank.candidates(observation, 0), size);
+				vector<bool> found = built.shortlist(bank, observation, 0, size);
+				same = same && found==loaded.shortlist(bank, observation, 0, size);
+				for(int m=0; m<scan.size(); m++){
+					if(scan[m]){
+						listed++;
+						if(found[m]) recalled++;
+					}
+				}
+			}
+			vector<bool> grownScan = grown.prefilter.shortlist(observation, grown.candidates(observation, 0), 10);
+			same = same && (!grownScan.back() || loaded.shortlist(grown, observation, 0, 10).back());
+		}
+	}
+	cout<<samples<<" samples, "<<recalled<<" of "<<listed<<" models of the scan's shortlists kept"<<endl;
+	cout<<(same ? "same after saving and loading" : "different after saving and loading")<<endl;
+	return same && samples>0 ? 0 : 1;//no samples read, nothing was checked
+}